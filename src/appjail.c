@@ -2,10 +2,22 @@
 
 #include "common.h"
 #include "child.h"
+#include "cgroup.h"
 #include "cap.h"
 #include "clone.h"
 #include "configfile.h"
+#include "eventlog.h"
+#include "idle.h"
+#include "listen.h"
+#include "log.h"
+#include "mounts.h"
+#include "network.h"
+#include "notify.h"
 #include "opts.h"
+#include "prefetch.h"
+#include "pressure.h"
+#include "redirect.h"
+#include "scratch.h"
 #include "wait.h"
 
 #include <fcntl.h>
@@ -15,16 +27,7 @@
 #include <signal.h>
 
 int appjail_main(int argc, char *argv[]) {
-  pid_t pid1;
-  int clone_flags;
-  appjail_options *opts;
   appjail_config *config;
-  child_options chldopts;
-  /* signalfd */
-  sigset_t mask, oldmask;
-  int sfd;
-  /* pipes */
-  int pipefds[2];
 
   /* Initialize the capability handling. Drop all privileges
    * we might accidentally have and only set the permitted
@@ -36,9 +39,34 @@ int appjail_main(int argc, char *argv[]) {
   config = parse_config();
   if(config == NULL)
     exit(EXIT_FAILURE);
+
+  return appjail_launch(argc, argv, config, -1);
+}
+
+/* Launch and supervise a jail. This is shared by appjail_main() and the
+ * launch server, which parses the configuration only once. When readyfd
+ * is not -1, our PID is written to it once the jail is initialized.
+ */
+int appjail_launch(int argc, char *argv[], const appjail_config *config, int readyfd) {
+  pid_t pid1;
+  int clone_flags;
+  strlist_node *l;
+  intlist_node *fd;
+  /* prefetch profile */
+  char *profile = NULL;
+  int fanfd = -1;
+  appjail_options *opts;
+  child_options chldopts;
+  /* signalfd */
+  sigset_t mask, oldmask;
+  int sfd;
+  /* pipes */
+  int pipefds[2];
+
   /* Parse command line */
   opts = parse_options(argc, argv, config);
-  free_config(config);
+  if(readyfd != -1 && opts->daemonize)
+    errExitNoErrno("--daemonize cannot be used for jails launched by the server.");
 
   if(!opts->allow_new_privs) {
     /* Ensure we never elevate privileges again */
@@ -62,9 +90,28 @@ int appjail_main(int argc, char *argv[]) {
     errExit("pipe");
   opts->pipefd = pipefds[1];
 
+  if(opts->prefetch != PREFETCH_OFF) {
+    /* Replay a recorded profile, or record the files the jail opens */
+    profile = prefetch_profile_path(opts->argv[0] != NULL ? opts->argv[0] : "/bin/sh");
+    if(profile == NULL)
+      fprintf(stderr, "Cannot find a directory for prefetch profiles.\n");
+    else if(opts->prefetch == PREFETCH_RECORD
+            || (!prefetch_load(opts->prefetch_files, profile) && opts->prefetch == PREFETCH_AUTO))
+      fanfd = prefetch_record_start();
+  }
+
+  /* Listening sockets are bound in the host's network namespace */
+  for(l = strlist_first(opts->listen); l != NULL; l = strlist_next(l))
+    intlist_append(opts->listenfds, open_listen_socket(strlist_val(l)));
+
+  /* The ipvlan interface is created in a network namespace
+   * that the jail joins */
+  if(opts->ipvlan_parent != NULL)
+    opts->netnsfd = create_ipvlan_namespace(opts->ipvlan_parent);
+
   /* Clone a child in an isolated namespace */
   clone_flags = CLONE_NEWNS | CLONE_NEWPID | SIGCHLD;
-  if(opts->unshare_network)
+  if(opts->unshare_network && opts->netnsfd == -1)
     clone_flags |= CLONE_NEWNET;
   if(!opts->keep_ipc_namespace)
     clone_flags |= CLONE_NEWIPC;
@@ -72,6 +119,59 @@ int appjail_main(int argc, char *argv[]) {
   chldopts.sfd = sfd;
   chldopts.old_sigmask = &oldmask;
   chldopts.daemonize = opts->daemonize;
+  chldopts.supervise = false;
+  chldopts.detached = false;
+  chldopts.log = NULL;
+  chldopts.events = NULL;
+  chldopts.readyfd = readyfd;
+  chldopts.notify = NULL;
+  chldopts.pidfd = -1;
+  chldopts.cgroup = NULL;
+  chldopts.pressure = NULL;
+  chldopts.idle = NULL;
+  chldopts.scratch = NULL;
+
+  if(opts->log_output != NULL) {
+    /* Open the log file before detaching, so errors are reported to the caller */
+    chldopts.log = log_output_open(opts->log_output, opts->log_max_size, opts->log_keep);
+    chldopts.supervise = true;
+    opts->logfd = chldopts.log->pipefd[1];
+  }
+
+  if(opts->scratch_dir != NULL) {
+    /* The supervisor deletes the scratch directory, even in --daemonize mode */
+    chldopts.scratch = scratch_create(opts->scratch_dir);
+    chldopts.supervise = true;
+    opts->scratch = chldopts.scratch;
+  }
+
+  if(opts->event_log != NULL) {
+    /* The jail's exit is recorded by a supervisor, even in --daemonize mode */
+    chldopts.events = event_log_open(opts->event_log);
+    chldopts.supervise = true;
+    opts->events = chldopts.events;
+  }
+
+  if(opts->notify_ready) {
+    /* The jail binds this socket, whoever waits for the jail receives
+     * its messages. No supervisor is needed, the launching process of
+     * a --daemonize jail exits once the jail is ready. The launch
+     * server's NOTIFY_SOCKET is not ours to use. */
+    chldopts.notify = notify_open(opts->notify_timeout, readyfd == -1);
+    opts->notifyfd = chldopts.notify->fd;
+  }
+
+  if(strlist_first(opts->pressure) != NULL || opts->reclaim_idle > 0 || opts->own_cgroup) {
+    /* Run the jail in its own cgroup, so the supervisor can watch
+     * the jail's pressure stall information and CPU usage, and the
+     * jail can be frozen */
+    chldopts.cgroup = jail_cgroup_create();
+    if(strlist_first(opts->pressure) != NULL)
+      chldopts.pressure = pressure_open(chldopts.cgroup->path, opts->pressure, opts->pressure_action);
+    if(opts->reclaim_idle > 0)
+      chldopts.idle = idle_open(chldopts.cgroup->path, opts->reclaim_idle);
+    chldopts.supervise = true;
+  }
 
   pid1 = launch_child(clone_flags, &chldopts, child_main, (void*)opts);
 
@@ -79,11 +179,50 @@ int appjail_main(int argc, char *argv[]) {
   if (pid1 == -1)
     errExit("launch_child");
 
+  /* Only the process that cloned the jail knows its PID */
+  if(!chldopts.daemonize || !chldopts.supervise)
+    event_log_write(chldopts.events, "spawn", "\"pid\":%d", (int)pid1);
+
   close(pipefds[1]);
+  if(opts->netnsfd != -1)
+    close(opts->netnsfd);
+  for(fd = intlist_first(opts->listenfds); fd != NULL; fd = intlist_next(fd))
+    close(intlist_val(fd));
+  if(fanfd != -1) {
+    if(!chldopts.daemonize || !chldopts.supervise)
+      prefetch_record(fanfd, pid1, profile, opts->prefetch_window);
+    close(fanfd);
+  }
+  free(profile);
+  if(chldopts.log != NULL)
+    log_output_close_writer(chldopts.log);
+
+  if(chldopts.daemonize && chldopts.cgroup != NULL) {
+    /* The detached supervisor owns the cgroup */
+    if(chldopts.pressure != NULL)
+      pressure_close(chldopts.pressure);
+    chldopts.pressure = NULL;
+    if(chldopts.idle != NULL)
+      idle_close(chldopts.idle);
+    chldopts.idle = NULL;
+    jail_cgroup_release(chldopts.cgroup);
+    chldopts.cgroup = NULL;
+  }
+
+  if(chldopts.detached) {
+    /* The launching process waits for the initialization, we
+     * only supervise the jail, away from the caller's terminal */
+    close(pipefds[0]);
+    pipefds[0] = -1;
+    if(chldopts.notify != NULL)
+      notify_close(chldopts.notify);
+    chldopts.notify = NULL;
+    redirect_to_dev_null(false, -1);
+  }
 
   /* Free some memory */
   free_options(opts);
 
-  wait_for_child(pid1, sfd, chldopts.daemonize, pipefds[0]);
+  wait_for_child(pid1, &chldopts, pipefds[0]);
   return EXIT_FAILURE;
 }
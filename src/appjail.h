@@ -1,3 +1,6 @@
 #pragma once
 
+#include "configfile.h"
+
 int appjail_main(int argc, char *argv[]);
+int appjail_launch(int argc, char *argv[], const appjail_config *config, int readyfd);
@@ -0,0 +1,76 @@
+#include "arena.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Memory is handed out from large blocks and only released all at once
+ * with arena_free(). Allocations never move.
+ */
+#define ARENA_BLOCK_SIZE 4096
+
+typedef struct arena_block arena_block;
+
+struct arena_block {
+  arena_block *next;
+  size_t used, size;
+  _Alignas(max_align_t) char data[];
+};
+
+struct arena {
+  arena_block *blocks;
+};
+
+static arena_block *add_block(arena *a, size_t size) {
+  arena_block *b;
+
+  if( (b = malloc(sizeof(arena_block) + size)) == NULL )
+    errExit("malloc");
+  b->used = 0;
+  b->size = size;
+  b->next = a->blocks;
+  a->blocks = b;
+
+  return b;
+}
+
+arena *arena_new() {
+  arena *a;
+
+  if( (a = malloc(sizeof(arena))) == NULL )
+    errExit("malloc");
+  a->blocks = NULL;
+
+  return a;
+}
+
+void arena_free(arena *a) {
+  arena_block *b, *next;
+
+  for(b = a->blocks; b != NULL; b = next) {
+    next = b->next;
+    free(b);
+  }
+  free(a);
+}
+
+void *arena_alloc(arena *a, size_t size) {
+  arena_block *b = a->blocks;
+  void *ret;
+
+  /* keep allocations aligned for any type */
+  size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+  if(b == NULL || b->size - b->used < size)
+    b = add_block(a, size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+  ret = b->data + b->used;
+  b->used += size;
+
+  return ret;
+}
+
+char *arena_strndup(arena *a, const char *s, size_t len) {
+  char *ret = arena_alloc(a, len + 1);
+
+  memcpy(ret, s, len);
+  ret[len] = '\0';
+
+  return ret;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common.h"
+
+struct arena;
+typedef struct arena arena;
+
+arena *arena_new();
+void arena_free(arena *a);
+
+void *arena_alloc(arena *a, size_t size);
+char *arena_strndup(arena *a, const char *s, size_t len);
@@ -1,13 +1,121 @@
 #include "cap.h"
 #include <sys/mount.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
-#include <pwd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
 
 static cap_t emptycaps = NULL;
 
+/* Setup statistics are kept in shared memory, so the setup tasks
+ * account for their privileged operations as well.
+ */
+typedef enum {
+  STAT_MOUNT, STAT_UMOUNT, STAT_OPEN_TREE, STAT_MOVE_MOUNT, STAT_PIVOT_ROOT,
+  STAT_CHOWN, STAT_MKNOD, STAT_SETUID, STAT_SETGID, STAT_CAPSET, NUM_STATS
+} cap_stat_t;
+
+static const char *stat_names[NUM_STATS] = {
+  "mount", "umount2", "open_tree", "move_mount", "pivot_root",
+  "chown", "mknod", "setreuid", "setregid", "capset"
+};
+
+typedef struct {
+  unsigned long long int calls, failed, nsec;
+} cap_counter;
+
+static cap_counter *counters = NULL;
+static bool trace_calls = false;
+static struct timespec stats_start;
+
+static unsigned long long int elapsed_nsec(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000000ULL + now.tv_nsec - start->tv_nsec;
+}
+
+static void stat_begin(struct timespec *start) {
+  if(counters != NULL)
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+/* Account for one call that returned r, errno is preserved */
+static void stat_end(cap_stat_t s, const struct timespec *start, int r, const char *path, const char *detail) {
+  unsigned long long int nsec;
+  int saved_errno = errno;
+
+  if(counters == NULL)
+    return;
+  nsec = elapsed_nsec(start);
+  __atomic_add_fetch(&(counters[s].calls), 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&(counters[s].nsec), nsec, __ATOMIC_RELAXED);
+  if(r == -1)
+    __atomic_add_fetch(&(counters[s].failed), 1, __ATOMIC_RELAXED);
+  if(trace_calls && path != NULL)
+    fprintf(stderr, APPLICATION_NAME ": %s%s%s %s %.3f ms%s%s\n", stat_names[s],
+            detail != NULL ? " " : "", detail != NULL ? detail : "", path, nsec / 1e6,
+            r == -1 ? ": " : "", r == -1 ? strerror(saved_errno) : "");
+  errno = saved_errno;
+}
+
+static const char *describe_mount(const char *filesystemtype, unsigned long mountflags) {
+  if(mountflags & MS_REMOUNT)
+    return mountflags & MS_RDONLY ? "remount,ro" : "remount";
+  if(mountflags & MS_PRIVATE)
+    return mountflags & MS_REC ? "make-rprivate" : "make-private";
+  if(mountflags & MS_SLAVE)
+    return mountflags & MS_REC ? "make-rslave" : "make-slave";
+  if(mountflags & MS_SHARED)
+    return mountflags & MS_REC ? "make-rshared" : "make-shared";
+  if(mountflags & MS_BIND)
+    return mountflags & MS_REC ? "rbind" : "bind";
+  return filesystemtype;
+}
+
+static int set_proc(cap_t caps) {
+  struct timespec start;
+  int r;
+
+  stat_begin(&start);
+  r = cap_set_proc(caps);
+  stat_end(STAT_CAPSET, &start, r, NULL, NULL);
+  return r;
+}
+
+void cap_stats_enable(bool trace) {
+  if(counters == NULL) {
+    counters = mmap(NULL, NUM_STATS * sizeof(cap_counter), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(counters == MAP_FAILED)
+      errExit("mmap");
+  }
+  memset(counters, 0, NUM_STATS * sizeof(cap_counter));
+  trace_calls = trace;
+  clock_gettime(CLOCK_MONOTONIC, &stats_start);
+}
+
+void cap_stats_report() {
+  int i;
+
+  if(counters == NULL)
+    return;
+  fprintf(stderr, APPLICATION_NAME ": Setup took %.3f ms.\n", elapsed_nsec(&stats_start) / 1e6);
+  for(i = 0; i < NUM_STATS; ++i)
+    if(counters[i].calls > 0)
+      fprintf(stderr, APPLICATION_NAME ":   %-10s %6llu calls %6llu failed %10.3f ms\n", stat_names[i],
+              counters[i].calls, counters[i].failed, counters[i].nsec / 1e6);
+}
+
 void init_caps() {
   cap_t prog;
   cap_flag_value_t val;
@@ -40,7 +148,7 @@ void init_caps() {
     cap_free(prog);
   }
 
-  if(cap_set_proc(emptycaps) == -1)
+  if(set_proc(emptycaps) == -1)
     errExit("cap_set_proc");
 }
 
@@ -53,7 +161,7 @@ bool want_cap(cap_value_t c) {
 
   caps = cap_dup(emptycaps);
   cap_set_flag(caps, CAP_EFFECTIVE, 1, &c, CAP_SET);
-  ret = cap_set_proc(caps) != -1;
+  ret = set_proc(caps) != -1;
   cap_free(caps);
 
   return ret;
@@ -68,14 +176,14 @@ void drop_caps() {
   if(emptycaps == NULL)
     errExitNoErrno("Internal error: drops_caps called, but emptycaps are not initialized.");
 
-  if(cap_set_proc(emptycaps) == -1)
+  if(set_proc(emptycaps) == -1)
     errExit("cap_set_proc");
 }
 
 void drop_caps_forever() {
   cap_t caps;
   caps = cap_init();
-  if(cap_set_proc(caps) == -1)
+  if(set_proc(caps) == -1)
     errExit("cap_set_proc");
   cap_free(caps);
 
@@ -88,20 +196,68 @@ void drop_caps_forever() {
 int cap_mount(const char *source, const char *target,
               const char *filesystemtype, unsigned long mountflags,
               const void *data) {
+  struct timespec start;
   int r;
 
   need_cap(CAP_SYS_ADMIN);
+  stat_begin(&start);
   r = mount(source, target, filesystemtype, mountflags, data);
+  stat_end(STAT_MOUNT, &start, r, target, describe_mount(filesystemtype, mountflags));
   drop_caps();
 
   return r;
 }
 
 int cap_umount2(const char *target, int flags) {
+  struct timespec start;
   int r;
 
   need_cap(CAP_SYS_ADMIN);
+  stat_begin(&start);
   r = umount2(target, flags);
+  stat_end(STAT_UMOUNT, &start, r, target, NULL);
+  drop_caps();
+
+  return r;
+}
+
+/* open_tree(), move_mount() and pivot_root() have no wrappers in
+ * older C libraries, we use the system calls directly.
+ */
+int cap_open_tree(const char *path, unsigned int flags) {
+  struct timespec start;
+  int r;
+
+  need_cap(CAP_SYS_ADMIN);
+  stat_begin(&start);
+  r = syscall(SYS_open_tree, AT_FDCWD, path, flags);
+  stat_end(STAT_OPEN_TREE, &start, r, path, NULL);
+  drop_caps();
+
+  return r;
+}
+
+int cap_move_mount(int fd, const char *target) {
+  struct timespec start;
+  int r;
+
+  need_cap(CAP_SYS_ADMIN);
+  stat_begin(&start);
+  r = syscall(SYS_move_mount, fd, "", AT_FDCWD, target, MOVE_MOUNT_F_EMPTY_PATH);
+  stat_end(STAT_MOVE_MOUNT, &start, r, target, NULL);
+  drop_caps();
+
+  return r;
+}
+
+int cap_pivot_root(const char *new_root, const char *put_old) {
+  struct timespec start;
+  int r;
+
+  need_cap(CAP_SYS_ADMIN);
+  stat_begin(&start);
+  r = syscall(SYS_pivot_root, new_root, put_old);
+  stat_end(STAT_PIVOT_ROOT, &start, r, new_root, NULL);
   drop_caps();
 
   return r;
@@ -110,10 +266,13 @@ int cap_umount2(const char *target, int flags) {
 int cap_mknod(const char *path, mode_t mode, dev_t dev) {
   static bool warned_mknod = false;
 
+  struct timespec start;
   int r;
 
   if (want_cap(CAP_MKNOD)) {
+    stat_begin(&start);
     r = mknod(path, mode, dev);
+    stat_end(STAT_MKNOD, &start, r, path, NULL);
     drop_caps();
   } else {
     r = -1;
@@ -129,10 +288,13 @@ int cap_mknod(const char *path, mode_t mode, dev_t dev) {
 
 int cap_chown(const char *path, uid_t owner, gid_t group) {
   static bool warned_chown = false;
+  struct timespec start;
   int r;
 
   if(want_cap(CAP_CHOWN)) {
+    stat_begin(&start);
     r = chown(path, owner, group);
+    stat_end(STAT_CHOWN, &start, r, path, NULL);
     drop_caps();
   }
   else {
@@ -147,18 +309,17 @@ int cap_chown(const char *path, uid_t owner, gid_t group) {
   return r;
 }
 
-int cap_setregid(uid_t new_gid) {
+int cap_setregid(gid_t new_gid, int ngroups, const gid_t *groups) {
   static bool warned_setgid = false;
+  struct timespec start;
   int r = -1;
 
   if(want_cap(CAP_SETGID)) {
-    struct passwd *pw = getpwuid(new_gid);
-
-    if (pw != NULL) {
-      initgroups(pw->pw_name, new_gid);
-
+    stat_begin(&start);
+    r = setgroups(ngroups, groups);
+    if (r == 0)
       r = setregid(new_gid, new_gid);
-    }
+    stat_end(STAT_SETGID, &start, r, NULL, NULL);
 
     drop_caps();
   } else {
@@ -175,10 +336,13 @@ int cap_setregid(uid_t new_gid) {
 
 int cap_setreuid(uid_t new_uid) {
   static bool warned_setuid = false;
+  struct timespec start;
   int r = -1;
 
   if(want_cap(CAP_SETUID)) {
+    stat_begin(&start);
     r = setreuid(new_uid, new_uid);
+    stat_end(STAT_SETUID, &start, r, NULL, NULL);
 
     drop_caps();
   } else {
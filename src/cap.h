@@ -13,7 +13,12 @@ int cap_mount(const char *source, const char *target,
               const char *filesystemtype, unsigned long mountflags,
               const void *data);
 int cap_umount2(const char *target, int flags);
+int cap_open_tree(const char *path, unsigned int flags);
+int cap_move_mount(int fd, const char *target);
+int cap_pivot_root(const char *new_root, const char *put_old);
 int cap_chown(const char *path, uid_t owner, gid_t group);
 int cap_mknod(const char *path, mode_t mode, dev_t dev);
 int cap_setreuid(uid_t new_uid);
-int cap_setregid(uid_t new_gid);
+int cap_setregid(gid_t new_gid, int ngroups, const gid_t *groups);
+void cap_stats_enable(bool trace);
+void cap_stats_report();
@@ -0,0 +1,157 @@
+#include "cgroup.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <linux/magic.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+/* Find a process's cgroup in the unified hierarchy */
+static char *process_cgroup(const char *file) {
+  char *line = NULL, *ret = NULL;
+  size_t len = 0;
+  ssize_t n;
+  FILE *f;
+
+  if( (f = fopen(file, "re")) == NULL )
+    errExit(file);
+  while( (n = getline(&line, &len, f)) != -1 )
+    if( !strncmp(line, "0::", 3) ) {
+      if( n > 0 && line[n-1] == '\n' )
+        line[n-1] = '\0';
+      ret = strdup(line + 3);
+      break;
+    }
+  free(line);
+  fclose(f);
+
+  return ret;
+}
+
+static char *own_cgroup() {
+  return process_cgroup("/proc/self/cgroup");
+}
+
+/* The jail's cgroup is named after the process that creates it */
+static void jail_cgroup_path(char *path, const char *own, pid_t owner) {
+  snprintf(path, PATH_MAX, CGROUP_ROOT "%s/" JAIL_CGROUP_PREFIX "%d", strcmp(own, "/") ? own : "", owner);
+}
+
+/* Create a cgroup for the jail below our own cgroup. This requires that
+ * our cgroup has been delegated to us, like a systemd user session.
+ */
+jail_cgroup *jail_cgroup_create() {
+  char path[PATH_MAX];
+  struct statfs sfs;
+  jail_cgroup *cg;
+  char *own;
+
+  if( statfs(CGROUP_ROOT, &sfs) == -1 || sfs.f_type != CGROUP2_SUPER_MAGIC
+      || (own = own_cgroup()) == NULL )
+    errExitNoErrno("The jail's cgroup requires the unified cgroup v2 hierarchy at " CGROUP_ROOT ".");
+
+  jail_cgroup_path(path, own, getpid());
+  free(own);
+  if( mkdir(path, 0755) == -1 )
+    errExit("mkdir cgroup");
+
+  if( (cg = malloc(sizeof(jail_cgroup))) == NULL )
+    errExit("malloc");
+  cg->path = strdup(path);
+  if( (cg->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 )
+    errExit("open cgroup");
+
+  return cg;
+}
+
+/* Forget about the cgroup, somebody else removes it */
+void jail_cgroup_release(jail_cgroup *cg) {
+  close(cg->fd);
+  free(cg->path);
+  free(cg);
+}
+
+/* Remove the cgroup once the jail has exited. All processes are gone
+ * when the jail's init process has been reaped.
+ */
+void jail_cgroup_remove(jail_cgroup *cg) {
+  if( rmdir(cg->path) == -1 && errno != ENOENT )
+    errWarn("rmdir cgroup");
+  jail_cgroup_release(cg);
+}
+
+/* The cgroup of a jail whose supervisor OWNER was forked by us, like
+ * the jails of the launch server. Returns NULL if it has none.
+ */
+char *jail_cgroup_of_owner(pid_t owner) {
+  char path[PATH_MAX];
+  struct stat st;
+  char *own;
+
+  if( (own = own_cgroup()) == NULL )
+    return NULL;
+  jail_cgroup_path(path, own, owner);
+  free(own);
+  if( stat(path, &st) == -1 )
+    return NULL;
+  return strdup(path);
+}
+
+/* The jail's cgroup.freeze stops or resumes all of its processes.
+ * Freezing takes effect asynchronously, cgroup.events tells when all
+ * processes are frozen.
+ */
+bool jail_cgroup_freeze(const char *path, bool frozen) {
+  char file[PATH_MAX];
+  bool ret;
+  int fd;
+
+  snprintf(file, PATH_MAX, "%s/cgroup.freeze", path);
+  if( (fd = open(file, O_WRONLY | O_CLOEXEC)) == -1 )
+    return false;
+  ret = write(fd, frozen ? "1" : "0", 1) == 1;
+  close(fd);
+  return ret;
+}
+
+/* Whether the jail is frozen or freezing. This is read back from
+ * cgroup.freeze, as appjail --thaw PID may have changed it behind
+ * the server's back. Signals to frozen processes stay pending.
+ */
+bool jail_cgroup_frozen(const char *path) {
+  char file[PATH_MAX], c = '0';
+  int fd;
+
+  snprintf(file, PATH_MAX, "%s/cgroup.freeze", path);
+  if( (fd = open(file, O_RDONLY | O_CLOEXEC)) == -1 )
+    return false;
+  if( read(fd, &c, 1) != 1 )
+    c = '0';
+  close(fd);
+  return c == '1';
+}
+
+/* appjail --freeze PID and --thaw PID, where PID is any process in a
+ * jail that runs in its own cgroup */
+int jail_cgroup_freeze_main(const char *pid, bool frozen) {
+  char file[PATH_MAX], path[PATH_MAX], *cg, *name;
+  int p;
+
+  if( !string_to_integer(&p, pid) || p <= 0 )
+    errExitNoErrno("Invalid PID.");
+  snprintf(file, PATH_MAX, "/proc/%d/cgroup", p);
+  if( (cg = process_cgroup(file)) == NULL
+      || (name = strrchr(cg, '/')) == NULL
+      || strncmp(name + 1, JAIL_CGROUP_PREFIX, strlen(JAIL_CGROUP_PREFIX)) )
+    errExitNoErrno("The process is not in a jail with its own cgroup.");
+  snprintf(path, PATH_MAX, CGROUP_ROOT "%s", cg);
+  free(cg);
+
+  if( !jail_cgroup_freeze(path, frozen) )
+    errExit(frozen ? "freeze" : "thaw");
+  return EXIT_SUCCESS;
+}
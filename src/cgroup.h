@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+#include <sys/types.h>
+
+/* Jail cgroups are called appjail-PID */
+#define JAIL_CGROUP_PREFIX "appjail-"
+
+typedef struct {
+  char *path;
+  /* directory fd, used with CLONE_INTO_CGROUP */
+  int fd;
+} jail_cgroup;
+
+jail_cgroup *jail_cgroup_create();
+void jail_cgroup_release(jail_cgroup *cg);
+void jail_cgroup_remove(jail_cgroup *cg);
+char *jail_cgroup_of_owner(pid_t owner);
+bool jail_cgroup_freeze(const char *path, bool frozen);
+bool jail_cgroup_frozen(const char *path);
+int jail_cgroup_freeze_main(const char *pid, bool frozen);
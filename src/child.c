@@ -3,8 +3,10 @@
 #include "cap.h"
 #include "devpts.h"
 #include "env.h"
+#include "eventlog.h"
 #include "fd.h"
 #include "initstub.h"
+#include "listen.h"
 #include "opts.h"
 #include "home.h"
 #include "mask.h"
@@ -17,22 +19,52 @@
 #include "tty.h"
 #include "x11.h"
 #include "setuid.h"
+#include "tasks.h"
+#include "seccomp.h"
+#include "landlock.h"
+#include "placement.h"
+#include "prefetch.h"
+#include "priority.h"
+#include "scratch.h"
+#include <limits.h>
+#include <sched.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/mount.h>
 
 #define DATA_SIZE 100
 
+static int configure_network_task(void *arg) {
+  appjail_options *opts = (appjail_options*)arg;
+
+  if( configure_loopback_interface() != 0 )
+    fprintf(stderr, "Unable to configure loopback interface.\n");
+  if( opts->ipvlan_parent != NULL
+      && configure_ipvlan_interface(opts->ipvlan_address, opts->ipvlan_gateway) != 0 ) {
+    fprintf(stderr, "Unable to configure ipvlan interface.\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
 int child_main(void *arg) {
   appjail_options *opts = (appjail_options*)arg;
   char **envp = NULL;
-  char data[DATA_SIZE];
+  char data[DATA_SIZE], nodes[DATA_SIZE/2], scratch_home[PATH_MAX];
+  setup_task *x11_cookie = NULL, *skeleton = NULL;
   data[0] = '\0';
 
+  if(opts->setup_stats)
+    cap_stats_enable(opts->setup_trace);
   init_libmount();
-  /* Set up the private network */
+  if(opts->netnsfd != -1)
+    join_network_namespace(opts->netnsfd);
+  /* Read the command's files into the page cache in the background */
+  if(strlist_first(opts->prefetch_files) != NULL)
+    task_start("prefetch", 0, prefetch_task, opts->prefetch_files);
+  /* Set up the private network in the background */
   if(opts->unshare_network)
-    if( configure_loopback_interface() != 0 )
-      fprintf(stderr, "Unable to configure loopback interface.\n");
+    task_start("network", 0, configure_network_task, opts);
   /* Make our mount a slave of the host - this will make sure our
    * mounts do not propagate to the host. If we made everything
    * private now, we would lose the ability to keep anything as slave.
@@ -45,40 +77,83 @@ int child_main(void *arg) {
     else
       snprintf(data, DATA_SIZE - 1, "size=%llu", opts->tmpfs_size);
   }
+  if( opts->has_numa_nodes ) {
+    /* Place the tmpfs pages like the jail's memory */
+    format_node_list(nodes, sizeof(nodes), &(opts->numa_nodes));
+    snprintf(data + strlen(data), DATA_SIZE - 1 - strlen(data), "%smpol=bind:%s", data[0] ? "," : "", nodes);
+  }
   if( cap_mount("appjail", APPJAIL_SWAPDIR, "tmpfs", MS_NODEV | MS_NOSUID, data) == -1 )
     errExit("mount -t tmpfs appjail " APPJAIL_SWAPDIR);
   /* Change into the temporary directory */
   if(chdir(APPJAIL_SWAPDIR) == -1)
     errExit("chdir()");
 
+  /* Populate the home directory in the background, with its own copy
+   * of the mount tree that still contains the skeleton */
+  if(opts->home_skeleton != NULL)
+    skeleton = task_start("home-skeleton", CLONE_NEWNS, copy_home_skeleton, opts);
+
   /* Bind directories and files that may disappear */
+  if(opts->scratch != NULL) {
+    bind_scratch_path(opts->scratch, SCRATCH_TMP, "tmp");
+    bind_scratch_path(opts->scratch, SCRATCH_VARTMP, "vartmp");
+    if(opts->homedir == NULL) {
+      snprintf(scratch_home, PATH_MAX, "%s/" SCRATCH_HOME, opts->scratch);
+      opts->homedir = scratch_home;
+    }
+  }
   get_home_directory(opts->homedir);
   get_tty(opts);
-  if(opts->keep_x11)
-    /* Get X11 socket directory and xauth data */
-    get_x11(opts);
+  if(opts->keep_x11) {
+    /* Get X11 socket directory, generate xauth data in the background
+     * with its own copy of the mount tree */
+    get_x11();
+    x11_cookie = task_start("xauth", CLONE_NEWNS, generate_x11_cookie, opts);
+  }
 
   /* clean up the mounts, making almost everything private */
-  sanitize_mounts(opts);
+  if(opts->minimal_root)
+    build_minimal_root(opts);
+  else
+    sanitize_mounts(opts);
 
   /* set up our private mounts */
   setup_path("tmp", "/tmp", 01777);
   setup_path("vartmp", "/var/tmp", 01777);
+  if(opts->scratch != NULL) {
+    unbind_scratch_path("tmp");
+    unbind_scratch_path("vartmp");
+  }
   setup_path("home", "/home", 0755);
-  if(!opts->keep_shm)
-    setup_path("shm", "/dev/shm", 01777);
+  if(!opts->keep_shm) {
+    if(opts->has_shm_size) {
+      snprintf(data, DATA_SIZE - 1, "size=%llu,mode=1777", opts->shm_size);
+      setup_private_fs("tmpfs", "/dev/shm", data);
+    }
+    else
+      setup_path("shm", "/dev/shm", 01777);
+  }
+  if(opts->has_hugetlbfs) {
+    snprintf(data, DATA_SIZE - 1, "pagesize=%llu,size=%llu,mode=1777",
+             opts->hugetlbfs_page_size, opts->hugetlbfs_size);
+    setup_private_fs("hugetlbfs", "/dev/hugepages", data);
+  }
   setup_devpts();
 
   /* set up the tty */
   setup_tty(opts);
   /* set up /run */
   setup_run(opts);
+  if(skeleton != NULL)
+    task_wait(skeleton);
   /* set up home directory using the one we bound earlier
    * WARNING: We change the current directory from APPJAIL_SWAPDIR to the home directory */
   setup_home_directory(opts->user);
-  if(opts->keep_x11)
+  if(opts->keep_x11) {
     /* Set up X11 socket directory and xauth data */
+    task_wait(x11_cookie);
     setup_x11();
+  }
 
   /* unmount our temporary directory */
   if( cap_umount2(APPJAIL_SWAPDIR, 0) == -1 )
@@ -95,33 +170,70 @@ int child_main(void *arg) {
   mask_directories(opts);
 
   /* Make the file system read-only */
-  if(opts->readonly)
+  if(opts->readonly && opts->mask_backend == MASK_MOUNT)
     make_read_only(opts);
 
   if (opts->switch_to_uid != 0) {
     fprintf(stdout, "Switchinf to id %d", opts->switch_to_uid);
 
-    if (switch_ids(opts->switch_to_uid)) {
+    if (switch_ids(&(opts->switch_identity))) {
       errExit("setuid");
     }
   }
 
+  /* Bind the supervisor's notification socket in our private /tmp,
+   * as the user that runs the jail */
+  if(opts->notifyfd != -1)
+    notify_bind(opts->notifyfd, APPJAIL_NOTIFY_SOCKET);
+
+  /* Join the remaining setup tasks */
+  task_wait_all();
+
+  /* Enforce --mask and --read-only without mounts */
+  if(opts->mask_backend == MASK_LANDLOCK)
+    apply_landlock(opts);
+
+  /* Install the seccomp filter while CAP_SYS_ADMIN can still be raised */
+  apply_seccomp_profile(opts->seccomp);
+
   /* We drop all capabilities from the permitted capability set */
   drop_caps_forever();
+  if(opts->setup_stats)
+    cap_stats_report();
 
   /* make sure no file descriptors leak into the jail */
   close_file_descriptors(opts->keepfds);
 
   /* set up the environment */
+  if(intlist_first(opts->listenfds) != NULL)
+    add_listen_env(opts->setenv, opts->listenfds, !opts->initstub);
+  if(opts->notify_ready)
+    strlist_append_copy(opts->setenv, "NOTIFY_SOCKET=" APPJAIL_NOTIFY_SOCKET);
   setup_environment(&envp, opts->cleanenv, opts->keepenv, opts->setenv);
 
+  /* Place the jail on its CPUs and NUMA nodes */
+  apply_placement(opts->has_cpus, &(opts->cpus), opts->has_numa_nodes, &(opts->numa_nodes), opts->thp);
+  /* Set the scheduling policy, priorities and timer slack */
+  apply_priority(&(opts->priority));
+
   if(opts->daemonize)
-    /* redirect stdin, stderr, stdout to /dev/null */
-    redirect_to_dev_null(opts->keep_output);
+    /* redirect stdin, stderr, stdout to /dev/null or the log pipe */
+    redirect_to_dev_null(opts->keep_output, opts->logfd);
 
   /* signal the main process */
   signal_mainpid(opts->pipefd);
 
+  /* The listening sockets may replace the event log's descriptor */
+  if(opts->events != NULL) {
+    char command[PATH_MAX];
+    json_escape(command, sizeof(command), opts->argv[0] != NULL ? opts->argv[0] : "/bin/sh");
+    event_log_write(opts->events, "exec", "\"command\":\"%s\"", command);
+  }
+
+  /* Pass the listening sockets, this may replace other descriptors */
+  if(intlist_first(opts->listenfds) != NULL)
+    pass_listen_fds(opts->listenfds);
+
   if(opts->initstub)
     run_initstub(opts->argv, envp);
 
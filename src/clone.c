@@ -2,15 +2,30 @@
 #include "common.h"
 #include "clone.h"
 #include "cap.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+
 /* glibc's clone() wrapper requires that you pass a non-NULL argument
  * for the child stack. This is unnecessary in our case and complicates
  * things. We use the system call directly.
  */
-static pid_t clone1(int flags) {
+pid_t clone1(int flags) {
   #if defined(__s390__) || defined(__s390x__) || defined(__cris__)
   return syscall(SYS_clone, NULL, flags);
   #else
@@ -18,6 +33,67 @@ static pid_t clone1(int flags) {
   #endif
 }
 
+/* struct clone_args from linux/sched.h, up to the cgroup field */
+struct clone3_args {
+  uint64_t flags;
+  uint64_t pidfd;
+  uint64_t child_tid;
+  uint64_t parent_tid;
+  uint64_t exit_signal;
+  uint64_t stack;
+  uint64_t stack_size;
+  uint64_t tls;
+  uint64_t set_tid;
+  uint64_t set_tid_size;
+  uint64_t cgroup;
+};
+/* size of the first version, without set_tid and cgroup */
+#define CLONE_ARGS_SIZE_VER0 64
+
+static void move_to_cgroup(int cgroupfd, pid_t pid) {
+  int fd;
+
+  if( (fd = openat(cgroupfd, "cgroup.procs", O_WRONLY | O_CLOEXEC)) == -1 )
+    errExit("open cgroup.procs");
+  if( dprintf(fd, "%d\n", pid) < 0 )
+    errExit("write cgroup.procs");
+  close(fd);
+}
+
+/* Like clone1(), but also get a pidfd for the child. Unlike the PID, the
+ * pidfd can never refer to a different process once the child has been
+ * reaped. On kernels without clone3(), *pidfd is set to -1.
+ * If cgroupfd is not -1, the child starts in that cgroup, or is moved
+ * there right away on kernels without CLONE_INTO_CGROUP.
+ */
+pid_t clone_pidfd(int flags, int cgroupfd, int *pidfd) {
+  struct clone3_args args;
+  pid_t ret;
+
+  memset(&args, 0, sizeof(args));
+  args.flags = (flags & ~CSIGNAL) | CLONE_PIDFD;
+  args.pidfd = (uint64_t)(uintptr_t)pidfd;
+  args.exit_signal = flags & CSIGNAL;
+  if(cgroupfd != -1) {
+    args.flags |= CLONE_INTO_CGROUP;
+    args.cgroup = cgroupfd;
+    ret = syscall(SYS_clone3, &args, sizeof(args));
+    /* Without clone3(), ENOSYS falls through to clone1() below */
+    if(ret != -1 || (errno != E2BIG && errno != EINVAL && errno != ENOSYS))
+      return ret;
+    args.flags &= ~CLONE_INTO_CGROUP;
+  }
+
+  ret = syscall(SYS_clone3, &args, CLONE_ARGS_SIZE_VER0);
+  if(ret == -1 && errno == ENOSYS) {
+    *pidfd = -1;
+    ret = clone1(flags);
+  }
+  if(ret > 0 && cgroupfd != -1)
+    move_to_cgroup(cgroupfd, ret);
+  return ret;
+}
+
 static void close_fd(int *fd) {
   /* Close *fd if necessary */
   if( *fd != -1 ) {
@@ -38,13 +114,13 @@ static void restore_sigmask( sigset_t **mask ) {
 pid_t launch_child(int flags, child_options *chldopts, int (*fn)(void *), void *arg) {
   pid_t ret;
 
-  if(chldopts->daemonize) {
+  chldopts->pidfd = -1;
+  if(chldopts->daemonize && chldopts->supervise) {
+    /* The supervisor needs its own process that outlives us. Without
+     * a supervisor, the jail is simply left behind when we exit. */
     ret = fork();
     switch(ret) {
       case 0:
-        /* Do some cleanup in the child */
-        close_fd(&(chldopts->sfd));
-        restore_sigmask(&(chldopts->old_sigmask));
         /* Become a session leader */
         if( setsid() == -1 )
           errExit("setsid");
@@ -58,7 +134,7 @@ pid_t launch_child(int flags, child_options *chldopts, int (*fn)(void *), void *
   }
 
   need_cap(CAP_SYS_ADMIN);
-  ret = clone1(flags);
+  ret = clone_pidfd(flags, chldopts->cgroup != NULL ? chldopts->cgroup->fd : -1, &(chldopts->pidfd));
   switch(ret) {
     case 0:
       /* Drop all capabilities from the effective capability set */
@@ -66,18 +142,21 @@ pid_t launch_child(int flags, child_options *chldopts, int (*fn)(void *), void *
       /* Do some cleanup in the child */
       close_fd(&(chldopts->sfd));
       restore_sigmask(&(chldopts->old_sigmask));
+      /* A daemonized jail becomes a session leader */
+      if( chldopts->daemonize && !chldopts->supervise && setsid() == -1 )
+        errExit("setsid");
       /* Call the function */
       fn(arg);
       /* The last call should not have returned */
       exit(EXIT_FAILURE);
     default:
-      if(chldopts->daemonize)
-        /* Parent, we exit right away */
-        exit(EXIT_SUCCESS);
-      else {
-        /* Parent, drop all capabilities from the permitted capability set */
-        drop_caps_forever();
-        return ret;
+      if(chldopts->daemonize && chldopts->supervise) {
+        /* Parent, we supervise the jail in the background */
+        chldopts->daemonize = false;
+        chldopts->detached = true;
       }
+      /* Parent, drop all capabilities from the permitted capability set */
+      drop_caps_forever();
+      return ret;
   }
 }
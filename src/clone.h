@@ -1,6 +1,12 @@
 #pragma once
 
 #include "common.h"
+#include "cgroup.h"
+#include "eventlog.h"
+#include "idle.h"
+#include "log.h"
+#include "notify.h"
+#include "pressure.h"
 #include <signal.h>
 #include <unistd.h>
 
@@ -8,6 +14,28 @@ typedef struct {
   int sfd;
   sigset_t *old_sigmask;
   bool daemonize;
+  /* In --daemonize mode, keep a detached supervisor process
+   * that outlives the launching process */
+  bool supervise;
+  /* Set in the detached supervisor process */
+  bool detached;
+  log_output *log;
+  /* Lifecycle events of the jail, or NULL */
+  event_log *events;
+  /* Notified when the jail is initialized (launch server) */
+  int readyfd;
+  /* The jail's sd_notify() socket with --notify-ready, or NULL */
+  notify_socket *notify;
+  /* pidfd of the jail's init process, or -1 */
+  int pidfd;
+  /* The jail's own cgroup and its PSI triggers, owned by the supervisor */
+  jail_cgroup *cgroup;
+  pressure_monitor *pressure;
+  idle_monitor *idle;
+  /* The jail's scratch directory, deleted by the supervisor */
+  char *scratch;
 } child_options;
 
+pid_t clone1(int flags);
+pid_t clone_pidfd(int flags, int cgroupfd, int *pidfd);
 pid_t launch_child(int flags, child_options *chldopts, int (*fn)(void *), void *arg);
@@ -1,14 +1,9 @@
 #include "command.h"
-#include "cap.h"
+#include <spawn.h>
 #include <unistd.h>
 #include <sys/wait.h>
 
-static int child(const char *file, char *const argv[]) {
-  /* Should be unnecessary, but let's still do it */
-  drop_caps_forever();
-  execvp(file, argv);
-  return EXIT_FAILURE;
-}
+extern char **environ;
 
 static int parent(pid_t childpid, bool wait) {
   int status;
@@ -23,16 +18,14 @@ static int parent(pid_t childpid, bool wait) {
     return EXIT_FAILURE;
 }
 
+/* posix_spawnp() uses vfork-style spawning, so the page tables of a
+ * large caller are not copied just to exec a helper. Capabilities do
+ * not survive the exec of a helper without file capabilities.
+ */
 int run_command(const char *file, char *const argv[], bool wait) {
   pid_t childpid;
-  
-  childpid = fork();
-  switch(childpid) {
-    case -1:
-      return EXIT_FAILURE;
-    case 0:
-      return child(file, argv);
-    default:
-      return parent(childpid, wait);
-  }
+
+  if( posix_spawnp(&childpid, file, NULL, NULL, argv, environ) != 0 )
+    return EXIT_FAILURE;
+  return parent(childpid, wait);
 }
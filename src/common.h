@@ -9,6 +9,7 @@
 typedef enum { false, true } bool;
 
 typedef enum { RUN_HOST, RUN_USER, RUN_PRIVATE } run_mode_t;
+typedef enum { MASK_MOUNT, MASK_LANDLOCK } mask_backend_t;
 
 #define errExit(msg) do { \
   perror(msg);\
@@ -1,5 +1,8 @@
 #include "configfile.h"
+#include "network.h"
 #include "opts.h"
+#include "placement.h"
+#include "priority.h"
 #include <glib.h>
 #include <sys/stat.h>
 #include <libgen.h>
@@ -10,6 +13,15 @@
 #define GRP_DEFAULTS "Defaults"
 #define KEY_ALLOW_NEW_PRIVS_PRERMITTED "PermitAllowNewPrivs"
 #define KEY_MAX_TMPFS_SIZE "MaxTmpfsSize"
+#define KEY_MAX_SHM_SIZE "MaxShmSize"
+#define KEY_MAX_HUGETLBFS_SIZE "MaxHugetlbfsSize"
+#define KEY_ALLOWED_CPUS "AllowedCPUs"
+#define KEY_ALLOWED_NUMA_NODES "AllowedNUMANodes"
+#define KEY_MIN_NICE "MinNice"
+#define KEY_MIN_IO_PRIORITY "MinIOPriority"
+#define KEY_MAX_PREFETCH_WINDOW "MaxPrefetchWindow"
+#define KEY_ALLOWED_IPVLAN_PARENTS "AllowedIpvlanParents"
+#define KEY_ALLOWED_IPVLAN_ADDRESSES "AllowedIpvlanAddresses"
 #define KEY_PRIVATE_NETWORK "PrivateNetwork"
 #define KEY_RUN_MODE "Run"
 #define KEY_RUN_MEDIA "RunMedia"
@@ -119,15 +131,99 @@ static bool get_size(GKeyFile *cfgfile, const char *group, const char *key, bool
   return ret;
 }
 
+static bool get_cpu_list(GKeyFile *cfgfile, const char *group, const char *key, bool *has_list, cpu_set_t *set) {
+  bool ret = false;
+  GError *err = NULL;
+  char *s;
+
+  s = g_key_file_get_string(cfgfile, group, key, &err);
+  if(err == NULL) {
+    ret = string_to_cpu_list(set, s);
+    if(ret)
+      *has_list = true;
+  }
+  else if(err->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND || err->code == G_KEY_FILE_ERROR_GROUP_NOT_FOUND) {
+    /* value not set */
+    ret = true;
+    *has_list = false;
+  }
+  g_clear_error(&err);
+  return ret;
+}
+
+static bool get_integer(GKeyFile *cfgfile, const char *group, const char *key, bool *has_value, int *result) {
+  bool ret = false;
+  GError *err = NULL;
+  int res;
+
+  res = g_key_file_get_integer(cfgfile, group, key, &err);
+  if(err == NULL) {
+    ret = true;
+    *has_value = true;
+    *result = res;
+  }
+  else if(err->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND || err->code == G_KEY_FILE_ERROR_GROUP_NOT_FOUND) {
+    /* value not set */
+    ret = true;
+    *has_value = false;
+  }
+  g_clear_error(&err);
+  return ret;
+}
+
+static bool get_ioprio(GKeyFile *cfgfile, const char *group, const char *key, bool *has_value, int *result) {
+  bool ret = false;
+  GError *err = NULL;
+  char *s;
+
+  s = g_key_file_get_string(cfgfile, group, key, &err);
+  if(err == NULL) {
+    ret = string_to_ioprio(result, s);
+    if(ret)
+      *has_value = true;
+  }
+  else if(err->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND || err->code == G_KEY_FILE_ERROR_GROUP_NOT_FOUND) {
+    /* value not set */
+    ret = true;
+    *has_value = false;
+  }
+  g_clear_error(&err);
+  return ret;
+}
+
+static bool get_string_list(GKeyFile *cfgfile, const char *group, const char *key, strlist *result) {
+  bool ret = false;
+  GError *err = NULL;
+  char **list;
+  gsize i, len;
+
+  list = g_key_file_get_string_list(cfgfile, group, key, &len, &err);
+  if(err == NULL) {
+    ret = true;
+    for(i = 0; i < len; ++i)
+      strlist_append_copy(result, list[i]);
+    g_strfreev(list);
+  }
+  else if(err->code == G_KEY_FILE_ERROR_KEY_NOT_FOUND || err->code == G_KEY_FILE_ERROR_GROUP_NOT_FOUND) {
+    /* value not set */
+    ret = true;
+  }
+  g_clear_error(&err);
+  return ret;
+}
+
 appjail_config *parse_config() {
   appjail_config *config;
   GKeyFile *cfgfile;
+  strlist_node *n;
 
   if(!check_permissions())
     return NULL;
 
   if((config = malloc(sizeof(appjail_config))) == NULL)
     errExit("malloc");
+  config->allowed_ipvlan_parents = strlist_new();
+  config->allowed_ipvlan_addresses = strlist_new();
 
   /* Parse configuration file */
   cfgfile = g_key_file_new();
@@ -144,6 +240,29 @@ appjail_config *parse_config() {
     goto parse_error;
   if(!get_size(cfgfile, GRP_PERMISSIONS, KEY_MAX_TMPFS_SIZE, &(config->has_max_tmpfs_size), &(config->max_tmpfs_size)))
     goto parse_error;
+  if(!get_size(cfgfile, GRP_PERMISSIONS, KEY_MAX_SHM_SIZE, &(config->has_max_shm_size), &(config->max_shm_size)))
+    goto parse_error;
+  if(!get_size(cfgfile, GRP_PERMISSIONS, KEY_MAX_HUGETLBFS_SIZE, &(config->has_max_hugetlbfs_size), &(config->max_hugetlbfs_size)))
+    goto parse_error;
+  if(!get_cpu_list(cfgfile, GRP_PERMISSIONS, KEY_ALLOWED_CPUS, &(config->has_allowed_cpus), &(config->allowed_cpus)))
+    goto parse_error;
+  if(!get_cpu_list(cfgfile, GRP_PERMISSIONS, KEY_ALLOWED_NUMA_NODES, &(config->has_allowed_numa_nodes), &(config->allowed_numa_nodes)))
+    goto parse_error;
+  if(!get_integer(cfgfile, GRP_PERMISSIONS, KEY_MIN_NICE, &(config->has_min_nice), &(config->min_nice)))
+    goto parse_error;
+  if(!get_ioprio(cfgfile, GRP_PERMISSIONS, KEY_MIN_IO_PRIORITY, &(config->has_min_ioprio), &(config->min_ioprio)))
+    goto parse_error;
+  if(!get_integer(cfgfile, GRP_PERMISSIONS, KEY_MAX_PREFETCH_WINDOW, &(config->has_max_prefetch_window), &(config->max_prefetch_window)))
+    goto parse_error;
+  if(config->has_max_prefetch_window && config->max_prefetch_window <= 0)
+    goto parse_error;
+  if(!get_string_list(cfgfile, GRP_PERMISSIONS, KEY_ALLOWED_IPVLAN_PARENTS, config->allowed_ipvlan_parents))
+    goto parse_error;
+  if(!get_string_list(cfgfile, GRP_PERMISSIONS, KEY_ALLOWED_IPVLAN_ADDRESSES, config->allowed_ipvlan_addresses))
+    goto parse_error;
+  for(n = strlist_first(config->allowed_ipvlan_addresses); n != NULL; n = strlist_next(n))
+    if(!is_valid_address(strlist_val(n)))
+      goto parse_error;
 
   g_key_file_free(cfgfile);
   return config;
@@ -155,5 +274,7 @@ parse_error:
 }
 
 void free_config(appjail_config *config) {
+  strlist_free(config->allowed_ipvlan_parents);
+  strlist_free(config->allowed_ipvlan_addresses);
   free(config);
 }
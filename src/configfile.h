@@ -1,11 +1,29 @@
 #pragma once
 
 #include "common.h"
+#include "list.h"
+#include <sched.h>
 
 typedef struct {
   bool allow_new_privs_permitted;
   bool has_max_tmpfs_size;
   unsigned long long int max_tmpfs_size;
+  bool has_max_shm_size;
+  unsigned long long int max_shm_size;
+  bool has_max_hugetlbfs_size;
+  unsigned long long int max_hugetlbfs_size;
+  bool has_allowed_cpus;
+  cpu_set_t allowed_cpus;
+  bool has_allowed_numa_nodes;
+  cpu_set_t allowed_numa_nodes;
+  bool has_min_nice;
+  int min_nice;
+  bool has_min_ioprio;
+  int min_ioprio;
+  bool has_max_prefetch_window;
+  int max_prefetch_window;
+  strlist *allowed_ipvlan_parents;
+  strlist *allowed_ipvlan_addresses;
   bool default_private_network;
   run_mode_t default_run_mode;
   bool default_bind_run_media;
@@ -5,39 +5,50 @@
 #include <string.h>
 
 static void setup_environment_clean(char ***envp, strlist *keep_env, strlist *set_env) {
-  size_t n, i;
-  const char *key, *val;
-  char *nkey, *pos;
+  size_t n, i, size, len;
+  const char *key, *val, *pos;
+  char *buf;
   strlist_node *s;
 
+  /* Variables from --set-env take precedence over kept ones */
+  size = 0;
+  for(s = strlist_first(set_env); s != NULL; s = strlist_next(s)) {
+    val = strlist_val(s);
+    pos = index(val, '=');
+    if(pos != NULL && pos != val) {
+      strlist_remove_len(keep_env, val, pos - val);
+      size += strlen(val) + 1;
+    }
+  }
+  for(s = strlist_first(keep_env); s != NULL; s = strlist_next(s))
+    if( (val = getenv(strlist_val(s))) != NULL )
+      size += strlen(strlist_val(s)) + strlen(val) + 2;
+
+  /* The pointer array and all strings share one allocation */
   n = strlist_count(keep_env) + strlist_count(set_env);
-  if( (*envp = (char **)malloc((n+1)*sizeof(char*))) == NULL )
+  if( (*envp = (char **)malloc((n+1)*sizeof(char*) + size)) == NULL )
     errExit("malloc");
+  buf = (char *)(*envp + n + 1);
 
   i = 0;
 
   for(s = strlist_first(set_env); s != NULL; s = strlist_next(s)) {
     val = strlist_val(s);
-    if( (nkey = strdup(val)) == NULL )
-      errExit("strdup");
-    pos = index(nkey, '=');
-    if(pos != NULL && pos != nkey) {
-      *pos = '\0';
-      strlist_remove(keep_env, nkey);
-      *pos = '=';
-      (*envp)[i++] = nkey;
+    pos = index(val, '=');
+    if(pos != NULL && pos != val) {
+      len = strlen(val) + 1;
+      memcpy(buf, val, len);
+      (*envp)[i++] = buf;
+      buf += len;
     }
-    else
-      free(nkey);
   }
 
   for(s = strlist_first(keep_env); s != NULL; s = strlist_next(s)) {
     key = strlist_val(s);
     val = getenv(key);
     if( val != NULL) {
-      if( ((*envp)[i] = (char*)malloc((strlen(key) + strlen(val) + 2)*sizeof(char))) == NULL )
-        errExit("malloc");
-      sprintf((*envp)[i++], "%s=%s", key, val);
+      (*envp)[i++] = buf;
+      buf += sprintf(buf, "%s=%s", key, val) + 1;
     }
   }
 
@@ -0,0 +1,140 @@
+#include "eventlog.h"
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Every event is written with a single write() or send(), so
+ * concurrent jails appending to the same file do not interleave
+ * their lines and every datagram holds exactly one event.
+ */
+#define EVENT_SIZE 1024
+
+static int open_event_socket(const char *path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if( strlen(path) >= sizeof(addr.sun_path) )
+    errExitNoErrno("The --event-log socket path is too long.");
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if( (fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) == -1 )
+    errExit("socket");
+  if( connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 )
+    errExit("connect to the event log socket");
+  return fd;
+}
+
+static void generate_jail_id(char *id) {
+  unsigned char r[16];
+  struct timespec ts;
+  size_t i;
+
+  if( getrandom(r, sizeof(r), GRND_NONBLOCK) != sizeof(r) ) {
+    /* Early in boot, fall back to something that is unique on this host */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snprintf(id, 33, "%016llx%08lx%08x", (unsigned long long int)ts.tv_sec,
+             (unsigned long int)ts.tv_nsec, (unsigned int)getpid());
+    return;
+  }
+  for(i = 0; i < sizeof(r); ++i)
+    sprintf(id + 2*i, "%02x", r[i]);
+}
+
+event_log *event_log_open(const char *dest) {
+  event_log *l;
+
+  if( (l = malloc(sizeof(event_log))) == NULL )
+    errExit("malloc");
+
+  if( !strncmp(dest, EVENT_LOG_SOCKET_PREFIX, strlen(EVENT_LOG_SOCKET_PREFIX)) ) {
+    l->fd = open_event_socket(dest + strlen(EVENT_LOG_SOCKET_PREFIX));
+    l->datagram = true;
+  }
+  else {
+    if( (l->fd = open(dest, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1 )
+      errExit("open event log");
+    l->datagram = false;
+  }
+
+  generate_jail_id(l->id);
+  if( gethostname(l->host, sizeof(l->host)) == -1 )
+    strcpy(l->host, "unknown");
+  l->host[sizeof(l->host)-1] = '\0';
+  return l;
+}
+
+void json_escape(char *buf, size_t size, const char *s) {
+  size_t n = 0;
+  int len;
+
+  for(; *s != '\0' && n + 1 < size; ++s) {
+    if( *s == '"' || *s == '\\' )
+      len = snprintf(buf + n, size - n, "\\%c", *s);
+    else if( (unsigned char)*s < 0x20 )
+      len = snprintf(buf + n, size - n, "\\u%04x", *s);
+    else
+      len = snprintf(buf + n, size - n, "%c", *s);
+    /* never leave half an escape sequence behind */
+    if( n + len >= size )
+      break;
+    n += len;
+  }
+  buf[n] = '\0';
+}
+
+/* Write one event as a line of JSON. FIELDS formats additional
+ * members of the object, or is NULL. Events are best effort, a full
+ * disk or a missing collector never stops the jail.
+ */
+void event_log_write(const event_log *l, const char *event, const char *fields, ...) {
+  char buf[EVENT_SIZE], host[2*HOST_NAME_MAX];
+  struct timespec mono, real;
+  va_list ap;
+  int n, m;
+
+  if( l == NULL )
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  clock_gettime(CLOCK_REALTIME, &real);
+  json_escape(host, sizeof(host), l->host);
+  n = snprintf(buf, sizeof(buf),
+               "{\"monotonic\":%lld.%09ld,\"time\":%lld.%06ld,\"host\":\"%s\",\"jail\":\"%s\",\"event\":\"%s\"",
+               (long long int)mono.tv_sec, mono.tv_nsec,
+               (long long int)real.tv_sec, real.tv_nsec / 1000,
+               host, l->id, event);
+  if( fields != NULL && n < (int)sizeof(buf) - 2 ) {
+    buf[n++] = ',';
+    va_start(ap, fields);
+    m = vsnprintf(buf + n, sizeof(buf) - n, fields, ap);
+    va_end(ap);
+    if( m < 0 || n + m >= (int)sizeof(buf) - 2 )
+      /* the event does not fit, drop the additional members */
+      n--;
+    else
+      n += m;
+  }
+  if( n >= (int)sizeof(buf) - 2 )
+    return;
+  buf[n++] = '}';
+  buf[n++] = '\n';
+
+  if( l->datagram )
+    send(l->fd, buf, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+  else if( write(l->fd, buf, n) == -1 )
+    errWarn("write event log");
+}
+
+void event_log_close(event_log *l) {
+  if( l == NULL )
+    return;
+  close(l->fd);
+  free(l);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+#include <limits.h>
+
+/* Prefix of --event-log destinations that are unix datagram sockets */
+#define EVENT_LOG_SOCKET_PREFIX "unix:"
+
+typedef struct {
+  int fd;
+  bool datagram;
+  /* Random id that identifies one jail in the events of all hosts */
+  char id[33];
+  char host[HOST_NAME_MAX+1];
+} event_log;
+
+event_log *event_log_open(const char *dest);
+void event_log_write(const event_log *l, const char *event, const char *fields, ...)
+  __attribute__((format(printf, 3, 4)));
+void event_log_close(event_log *l);
+void json_escape(char *buf, size_t size, const char *s);
@@ -0,0 +1,111 @@
+#include "cap.h"
+#include <sys/mount.h>
+#include <errno.h>
+#include <string.h>
+
+/* A stand-in for cap.c in mount-sim, which needs no privileges. Nothing
+ * is mounted or changed: every operation is counted, printed to stdout
+ * if tracing is on, and reports success. The operations of a minimal
+ * root are not simulated and fail with ENOSYS.
+ */
+typedef enum {
+  STAT_MOUNT, STAT_UMOUNT, STAT_CHOWN, STAT_MKNOD, NUM_STATS
+} cap_stat_t;
+
+static const char *stat_names[NUM_STATS] = {
+  "mount", "umount2", "chown", "mknod"
+};
+
+static unsigned long long int counters[NUM_STATS];
+static bool trace_calls = false;
+
+static const char *describe_mount(const char *filesystemtype, unsigned long mountflags) {
+  if(mountflags & MS_REMOUNT)
+    return mountflags & MS_RDONLY ? "remount,ro" : "remount";
+  if(mountflags & MS_PRIVATE)
+    return mountflags & MS_REC ? "make-rprivate" : "make-private";
+  if(mountflags & MS_SLAVE)
+    return mountflags & MS_REC ? "make-rslave" : "make-slave";
+  if(mountflags & MS_SHARED)
+    return mountflags & MS_REC ? "make-rshared" : "make-shared";
+  if(mountflags & MS_BIND)
+    return mountflags & MS_REC ? "rbind" : "bind";
+  return filesystemtype;
+}
+
+static int account(cap_stat_t s, const char *path, const char *detail) {
+  counters[s]++;
+  if(trace_calls)
+    printf("%s%s%s %s\n", stat_names[s], detail != NULL ? " " : "", detail != NULL ? detail : "", path);
+  return 0;
+}
+
+void cap_stats_enable(bool trace) {
+  memset(counters, 0, sizeof(counters));
+  trace_calls = trace;
+}
+
+void cap_stats_report() {
+  int i;
+
+  for(i = 0; i < NUM_STATS; ++i)
+    if(counters[i] > 0)
+      printf("%-10s %6llu calls\n", stat_names[i], counters[i]);
+}
+
+void init_caps() {
+}
+
+bool want_cap(cap_value_t c) {
+  return true;
+}
+
+void need_cap(cap_value_t c) {
+}
+
+void drop_caps() {
+}
+
+void drop_caps_forever() {
+}
+
+int cap_mount(const char *source, const char *target,
+              const char *filesystemtype, unsigned long mountflags,
+              const void *data) {
+  return account(STAT_MOUNT, target, describe_mount(filesystemtype, mountflags));
+}
+
+int cap_umount2(const char *target, int flags) {
+  return account(STAT_UMOUNT, target, NULL);
+}
+
+int cap_open_tree(const char *path, unsigned int flags) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int cap_move_mount(int fd, const char *target) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int cap_pivot_root(const char *new_root, const char *put_old) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int cap_chown(const char *path, uid_t owner, gid_t group) {
+  return account(STAT_CHOWN, path, NULL);
+}
+
+int cap_mknod(const char *path, mode_t mode, dev_t dev) {
+  return account(STAT_MKNOD, path, NULL);
+}
+
+int cap_setregid(gid_t new_gid, int ngroups, const gid_t *groups) {
+  return 0;
+}
+
+int cap_setreuid(uid_t new_uid) {
+  return 0;
+}
@@ -1,12 +1,30 @@
 #include "common.h"
 #include "home.h"
 #include "cap.h"
+#include "opts.h"
+#include "scratch.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/mount.h>
+#include <sys/sendfile.h>
+#include <sys/wait.h>
+
+/* Regular files of the skeleton are copied by up to this many processes */
+#define SKELETON_WORKERS 4
+#define SKELETON_FILES_PER_WORKER 64
+
+/* From <linux/fs.h>, which conflicts with <sys/mount.h> */
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 
 void get_home_directory(const char *homedir) {
   struct stat st;
@@ -30,7 +48,8 @@ void setup_home_directory(const char *user) {
   struct stat st;
 
   snprintf(dir, PATH_MAX-1, "/home/%s", user);
-  if(mkdir(dir, 0755) == -1)
+  /* it already exists if it was populated from a skeleton */
+  if(mkdir(dir, 0755) == -1 && errno != EEXIST)
     errExit("mkdir");
   if(setenv("HOME", dir, 1) == -1)
     errExit("setenv");
@@ -42,3 +61,141 @@ void setup_home_directory(const char *user) {
   if(chdir(dir) == -1)
     errExit("chdir");
 }
+
+static void skeleton_error(const char *path) {
+  if(errno == ENOSPC)
+    fprintf(stderr, "The home skeleton does not fit into the jail's home directory.\n");
+  else
+    fprintf(stderr, "Unable to copy %s from the home skeleton: %s\n", path, strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+/* Create the directories and symbolic links right away and collect the
+ * regular files, which are copied in parallel afterwards */
+static void walk_skeleton(int srcfd, int dstfd, const char *prefix, strlist *files) {
+  char path[PATH_MAX], target[PATH_MAX];
+  struct dirent *e;
+  struct stat st;
+  DIR *d;
+  int sub, subdst;
+  ssize_t len;
+
+  if( (d = fdopendir(srcfd)) == NULL )
+    skeleton_error(prefix);
+  while( (e = readdir(d)) != NULL ) {
+    if(!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+      continue;
+    snprintf(path, sizeof(path), "%s%s", prefix, e->d_name);
+    if( fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 )
+      skeleton_error(path);
+    if(S_ISDIR(st.st_mode)) {
+      /* we must be able to fill read-only directories */
+      if( mkdirat(dstfd, e->d_name, (st.st_mode & 0777) | S_IRWXU) == -1 && errno != EEXIST )
+        skeleton_error(path);
+      if( (sub = openat(dirfd(d), e->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) == -1
+          || (subdst = openat(dstfd, e->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) == -1 )
+        skeleton_error(path);
+      strcat(path, "/");
+      walk_skeleton(sub, subdst, path, files);
+      close(subdst);
+    }
+    else if(S_ISLNK(st.st_mode)) {
+      if( (len = readlinkat(dirfd(d), e->d_name, target, sizeof(target) - 1)) == -1 )
+        skeleton_error(path);
+      target[len] = '\0';
+      if( symlinkat(target, dstfd, e->d_name) == -1 && errno != EEXIST )
+        skeleton_error(path);
+    }
+    else if(S_ISREG(st.st_mode))
+      strlist_append_copy(files, path);
+    /* devices, fifos and sockets are not copied */
+  }
+  closedir(d);
+}
+
+static void copy_file(int srcroot, int dstroot, const char *path) {
+  struct stat st;
+  struct timespec times[2];
+  int in, out;
+  ssize_t n;
+  bool kernel_copy = true;
+
+  if( (in = openat(srcroot, path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) == -1 || fstat(in, &st) == -1 )
+    skeleton_error(path);
+  if( (out = openat(dstroot, path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 0777)) == -1 )
+    skeleton_error(path);
+  /* A home directory in the --scratch-dir may share the skeleton's file
+   * system, where a reflink costs nothing. The jail's tmpfs is always a
+   * different file system, where copy_file_range() may refuse to copy,
+   * but the data still never passes through us. */
+  if( ioctl(out, FICLONE, in) == -1 ) {
+    do {
+      n = kernel_copy ? copy_file_range(in, NULL, out, NULL, 1 << 30, 0) : sendfile(out, in, NULL, 1 << 30);
+      if( n == -1 && kernel_copy && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) ) {
+        kernel_copy = false;
+        n = 1;
+      }
+    } while(n > 0);
+    if(n == -1)
+      skeleton_error(path);
+  }
+  times[0] = st.st_atim;
+  times[1] = st.st_mtim;
+  futimens(out, times);
+  close(in);
+  close(out);
+}
+
+/* Setup task: populate the jail's home directory from the skeleton, that
+ * is ./home/USER on the jail's tmpfs, or the home directory in the
+ * --scratch-dir. It runs in its own copy of the mount tree, so
+ * child_main() can unmount the skeleton's file system in the meantime.
+ */
+int copy_home_skeleton(void *arg) {
+  appjail_options *opts = (appjail_options*)arg;
+  char dir[PATH_MAX];
+  strlist *files;
+  strlist_node *n;
+  int srcfd, dstfd, workers, i, k, status;
+  pid_t pids[SKELETON_WORKERS];
+
+  /* The home directory in the scratch directory is bound later */
+  if(opts->scratch != NULL)
+    snprintf(dir, PATH_MAX-1, "%s/" SCRATCH_HOME, opts->scratch);
+  else {
+    snprintf(dir, PATH_MAX-1, "./home/%s", opts->user);
+    if( (mkdir("./home", 0755) == -1 && errno != EEXIST) || (mkdir(dir, 0755) == -1 && errno != EEXIST) )
+      errExit("mkdir");
+  }
+  if( (srcfd = open(opts->home_skeleton, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 )
+    errExit("Could not open the home skeleton");
+  if( (dstfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 )
+    errExit("open");
+
+  files = strlist_new();
+  walk_skeleton(dup(srcfd), dstfd, "", files);
+
+  workers = strlist_count(files) / SKELETON_FILES_PER_WORKER + 1;
+  if(workers > SKELETON_WORKERS)
+    workers = SKELETON_WORKERS;
+  for(k = 0; k < workers; ++k) {
+    if( (pids[k] = fork()) == -1 )
+      errExit("fork");
+    if(pids[k] == 0) {
+      for(n = strlist_first(files), i = 0; n != NULL; n = strlist_next(n), ++i)
+        if(i % workers == k)
+          copy_file(srcfd, dstfd, strlist_val(n));
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  status = EXIT_SUCCESS;
+  for(k = 0; k < workers; ++k) {
+    if( waitpid(pids[k], &i, 0) == -1 || !WIFEXITED(i) || WEXITSTATUS(i) != EXIT_SUCCESS )
+      status = EXIT_FAILURE;
+  }
+
+  strlist_free(files);
+  close(srcfd);
+  close(dstfd);
+  return status;
+}
@@ -2,3 +2,4 @@
 
 void get_home_directory(const char *homedir);
 void setup_home_directory(const char *user);
+int copy_home_skeleton(void *arg);
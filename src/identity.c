@@ -0,0 +1,102 @@
+#include "identity.h"
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <string.h>
+#include <time.h>
+
+/* NSS lookups can be slow (LDAP, sssd), and the server looks up the same
+ * few users for every launch. Remember recent results for a while.
+ */
+#define IDENTITY_CACHE_SIZE 8
+#define IDENTITY_CACHE_TTL 60
+
+typedef struct {
+  identity id;
+  time_t expires;
+  bool valid;
+} cache_entry;
+
+static cache_entry cache[IDENTITY_CACHE_SIZE];
+static unsigned int next_entry = 0;
+
+static time_t now() {
+  struct timespec ts;
+
+  if( clock_gettime(CLOCK_MONOTONIC, &ts) == -1 )
+    errExit("clock_gettime");
+  return ts.tv_sec;
+}
+
+static void copy_identity(identity *dst, const identity *src) {
+  dst->uid = src->uid;
+  dst->gid = src->gid;
+  dst->ngroups = src->ngroups;
+  if( (dst->name = strdup(src->name)) == NULL )
+    errExit("strdup");
+  if( (dst->groups = malloc(src->ngroups * sizeof(gid_t))) == NULL )
+    errExit("malloc");
+  memcpy(dst->groups, src->groups, src->ngroups * sizeof(gid_t));
+}
+
+static bool query_identity(uid_t uid, identity *result) {
+  struct passwd *pw;
+  int ngroups = 32;
+
+  errno = 0;
+  if( (pw = getpwuid(uid)) == NULL )
+    return false;
+  result->uid = uid;
+  result->gid = pw->pw_gid;
+  if( (result->name = strdup(pw->pw_name)) == NULL )
+    errExit("strdup");
+
+  result->groups = NULL;
+  do {
+    if( (result->groups = realloc(result->groups, ngroups * sizeof(gid_t))) == NULL )
+      errExit("realloc");
+    /* on failure, ngroups is set to the required size */
+  } while( getgrouplist(result->name, result->gid, result->groups, &ngroups) == -1 );
+  result->ngroups = ngroups;
+
+  return true;
+}
+
+bool lookup_identity(uid_t uid, identity *result) {
+  unsigned int i;
+  time_t t = now();
+  cache_entry *e = NULL;
+
+  for(i = 0; i < IDENTITY_CACHE_SIZE; ++i) {
+    if(!cache[i].valid || cache[i].id.uid != uid)
+      continue;
+    if(cache[i].expires > t) {
+      copy_identity(result, &(cache[i].id));
+      return true;
+    }
+    /* expired, refresh this entry */
+    e = &(cache[i]);
+  }
+
+  if(!query_identity(uid, result))
+    return false;
+
+  if(e == NULL) {
+    e = &(cache[next_entry]);
+    next_entry = (next_entry + 1) % IDENTITY_CACHE_SIZE;
+  }
+  if(e->valid)
+    free_identity(&(e->id));
+  copy_identity(&(e->id), result);
+  e->expires = t + IDENTITY_CACHE_TTL;
+  e->valid = true;
+
+  return true;
+}
+
+void free_identity(identity *id) {
+  free(id->name);
+  free(id->groups);
+  id->name = NULL;
+  id->groups = NULL;
+}
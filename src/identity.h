@@ -0,0 +1,16 @@
+#pragma once
+
+#include "common.h"
+#include <sys/types.h>
+
+typedef struct {
+  uid_t uid;
+  gid_t gid;
+  char *name;
+  /* supplementary groups, including gid */
+  int ngroups;
+  gid_t *groups;
+} identity;
+
+bool lookup_identity(uid_t uid, identity *result);
+void free_identity(identity *id);
@@ -0,0 +1,179 @@
+#include "idle.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* The jail counts as idle while it uses less than this share
+ * (in percent) of one CPU */
+#define IDLE_CPU_PERCENT 1
+#define MIN_INTERVAL_SEC 1
+#define MAX_INTERVAL_SEC 60
+
+/* Read KEY from a flat keyed cgroup file like cpu.stat, or the single
+ * value of a file like memory.current when KEY is NULL */
+static bool read_cgroup_value(const char *cgroup, const char *file, const char *key,
+                              unsigned long long int *value) {
+  char path[PATH_MAX], name[64];
+  unsigned long long int v;
+  bool ret = false;
+  FILE *f;
+
+  snprintf(path, PATH_MAX, "%s/%s", cgroup, file);
+  if( (f = fopen(path, "re")) == NULL )
+    return false;
+  if(key == NULL)
+    ret = fscanf(f, "%llu", value) == 1;
+  else
+    while( fscanf(f, "%63s %llu", name, &v) == 2 )
+      if(!strcmp(name, key)) {
+        *value = v;
+        ret = true;
+        break;
+      }
+  fclose(f);
+  return ret;
+}
+
+/* Check the jail's CPU usage every quarter of IDLE_TIME seconds */
+idle_monitor *idle_open(const char *cgroup, unsigned int idle_time) {
+  char path[PATH_MAX];
+  struct itimerspec its;
+  unsigned int interval;
+  idle_monitor *m;
+
+  snprintf(path, PATH_MAX, "%s/memory.reclaim", cgroup);
+  if( access(path, W_OK) == -1 )
+    errExitNoErrno("--reclaim-idle requires the memory controller in the jail's cgroup (Linux 5.19 or newer).");
+
+  if( (m = malloc(sizeof(idle_monitor))) == NULL )
+    errExit("malloc");
+  m->cgroup = strdup(cgroup);
+  interval = idle_time / 4;
+  if(interval < MIN_INTERVAL_SEC)
+    interval = MIN_INTERVAL_SEC;
+  else if(interval > MAX_INTERVAL_SEC)
+    interval = MAX_INTERVAL_SEC;
+  m->idle_usec = idle_time * 1000000ULL;
+  m->interval_usec = interval * 1000000ULL;
+  m->usage_usec = 0;
+  m->idle_for_usec = 0;
+  m->reclaimed = false;
+  m->reclaimfd = -1;
+
+  if( (m->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1 )
+    errExit("timerfd_create");
+  its.it_value.tv_sec = its.it_interval.tv_sec = interval;
+  its.it_value.tv_nsec = its.it_interval.tv_nsec = 0;
+  if( timerfd_settime(m->timerfd, 0, &its, NULL) == -1 )
+    errExit("timerfd_settime");
+
+  return m;
+}
+
+/* Push the jail's memory out and return the number of bytes that were
+ * freed. This can take seconds for a large jail. */
+static unsigned long long int reclaim(const char *cgroup) {
+  unsigned long long int before, after;
+  char path[PATH_MAX], value[32];
+  int fd, len;
+
+  if( !read_cgroup_value(cgroup, "memory.current", NULL, &before) )
+    return 0;
+  /* Ask for everything, the kernel stops when nothing more can be
+   * reclaimed and fails with EAGAIN */
+  len = snprintf(value, sizeof(value), "%llu", before);
+  snprintf(path, PATH_MAX, "%s/memory.reclaim", cgroup);
+  if( (fd = open(path, O_WRONLY | O_CLOEXEC)) == -1 )
+    return 0;
+  if( write(fd, value, len) == -1 && errno != EAGAIN )
+    errWarn("write memory.reclaim");
+  close(fd);
+  if( !read_cgroup_value(cgroup, "memory.current", NULL, &after) )
+    after = before;
+  return before > after ? before - after : 0;
+}
+
+/* Reclaim in a background process, so the supervisor keeps forwarding
+ * signals and draining the log meanwhile. Double fork like
+ * scratch_remove(), the result comes back through m->reclaimfd. */
+static void start_reclaim(idle_monitor *m) {
+  unsigned long long int reclaimed;
+  int pipefds[2];
+  pid_t pid;
+
+  if( pipe2(pipefds, O_CLOEXEC) == -1 ) {
+    errWarn("pipe");
+    return;
+  }
+  fflush(NULL);
+  if( (pid = fork()) == -1 ) {
+    errWarn("fork");
+    close(pipefds[0]);
+    close(pipefds[1]);
+    return;
+  }
+  if( pid == 0 ) {
+    close(pipefds[0]);
+    if( fork() != 0 )
+      _exit(EXIT_SUCCESS);
+    reclaimed = reclaim(m->cgroup);
+    if( write(pipefds[1], &reclaimed, sizeof(reclaimed)) != sizeof(reclaimed) )
+      _exit(EXIT_FAILURE);
+    _exit(EXIT_SUCCESS);
+  }
+  close(pipefds[1]);
+  waitpid(pid, NULL, 0);
+  m->reclaimfd = pipefds[0];
+}
+
+/* Called when the timer expired. Once the jail has been idle for long
+ * enough, its memory is pushed out in the background, see
+ * idle_reclaimed().
+ */
+void idle_check(idle_monitor *m) {
+  unsigned long long int usage;
+  uint64_t expirations;
+
+  if( read(m->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations) )
+    return;
+  if( !read_cgroup_value(m->cgroup, "cpu.stat", "usage_usec", &usage) )
+    return;
+
+  if( usage - m->usage_usec > expirations * m->interval_usec * IDLE_CPU_PERCENT / 100 ) {
+    /* the jail is busy, start over */
+    m->idle_for_usec = 0;
+    m->reclaimed = false;
+  }
+  else
+    m->idle_for_usec += expirations * m->interval_usec;
+  m->usage_usec = usage;
+
+  if( m->reclaimed || m->reclaimfd != -1 || m->idle_for_usec < m->idle_usec )
+    return;
+  m->reclaimed = true;
+  start_reclaim(m);
+}
+
+/* Called when m->reclaimfd is readable. Returns true if the memory was
+ * pushed out, RECLAIMED is the number of bytes that were freed. */
+bool idle_reclaimed(idle_monitor *m, unsigned long long int *reclaimed) {
+  bool ret;
+
+  ret = read(m->reclaimfd, reclaimed, sizeof(*reclaimed)) == sizeof(*reclaimed);
+  close(m->reclaimfd);
+  m->reclaimfd = -1;
+  return ret;
+}
+
+void idle_close(idle_monitor *m) {
+  close(m->timerfd);
+  if( m->reclaimfd != -1 )
+    close(m->reclaimfd);
+  free(m->cgroup);
+  free(m);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+
+typedef struct {
+  /* expires every interval_usec, readable for select() */
+  int timerfd;
+  char *cgroup;
+  unsigned long long int idle_usec, interval_usec;
+  /* the cgroup's CPU usage at the last check, and how long it stayed idle */
+  unsigned long long int usage_usec, idle_for_usec;
+  /* memory is reclaimed once per idle period */
+  bool reclaimed;
+  /* reports the result of a running reclaim, readable for select(), or -1 */
+  int reclaimfd;
+} idle_monitor;
+
+idle_monitor *idle_open(const char *cgroup, unsigned int idle_time);
+void idle_check(idle_monitor *m);
+bool idle_reclaimed(idle_monitor *m, unsigned long long int *reclaimed);
+void idle_close(idle_monitor *m);
@@ -37,6 +37,23 @@ void run_initstub(char *argv[], char **envp) {
   errExit("Failed to execute init stub.");
 }
 
+/* posix_spawn() cannot put the command's own PID into its environment */
+static void run_listen_command(char *argv[]) {
+  char pid[16];
+
+  switch(fork()) {
+    case -1:
+      errExit("fork");
+    case 0:
+      snprintf(pid, sizeof(pid), "%d", (int)getpid());
+      setenv("LISTEN_PID", pid, 1);
+      execvp(argv[0], argv);
+      errExit("execvp");
+    default:
+      break;
+  }
+}
+
 int initstub_main(int argc, char *argv[]) {
   int status, i;
   char *argv0 = argv[0];
@@ -44,7 +61,10 @@ int initstub_main(int argc, char *argv[]) {
   if(argc <= 1)
     return EXIT_FAILURE;
 
-  run_command(argv[1], argv+1, false);
+  if(getenv("LISTEN_FDS") != NULL)
+    run_listen_command(argv+1);
+  else
+    run_command(argv[1], argv+1, false);
 
   for(i = 0; i < argc; ++i)
     memset(argv[i], 0, strlen(argv[i]));
@@ -0,0 +1,223 @@
+#include "landlock.h"
+#include "list_helpers.h"
+#include "cap.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <linux/landlock.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef SYS_landlock_create_ruleset
+#define SYS_landlock_create_ruleset 444
+#define SYS_landlock_add_rule 445
+#define SYS_landlock_restrict_self 446
+#endif
+
+/* access rights added after the first Landlock ABI */
+#ifndef LANDLOCK_ACCESS_FS_REFER
+#define LANDLOCK_ACCESS_FS_REFER (1ULL << 13)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_IOCTL_DEV
+#define LANDLOCK_ACCESS_FS_IOCTL_DEV (1ULL << 15)
+#endif
+
+#define ACCESS_FS_V1 ((LANDLOCK_ACCESS_FS_MAKE_SYM << 1) - 1)
+
+/* The only rights that may be granted on files that are not directories */
+#define ACCESS_FILE ( LANDLOCK_ACCESS_FS_EXECUTE \
+                    | LANDLOCK_ACCESS_FS_WRITE_FILE \
+                    | LANDLOCK_ACCESS_FS_READ_FILE \
+                    | LANDLOCK_ACCESS_FS_TRUNCATE \
+                    | LANDLOCK_ACCESS_FS_IOCTL_DEV )
+
+#define ACCESS_READ ( LANDLOCK_ACCESS_FS_EXECUTE \
+                    | LANDLOCK_ACCESS_FS_READ_FILE \
+                    | LANDLOCK_ACCESS_FS_READ_DIR )
+
+/* Directories that stay writable with --read-only, like the mounts
+ * make_read_only() leaves alone */
+static const char *writable_paths[] = { "/dev", "/proc", "/run", "/tmp", "/var/tmp", NULL };
+
+typedef struct {
+  int fd;
+  __u64 handled;
+  strlist *masks;
+} ruleset;
+
+static int landlock_abi() {
+  static int abi = -1;
+
+  if(abi == -1) {
+    abi = syscall(SYS_landlock_create_ruleset, NULL, 0, LANDLOCK_CREATE_RULESET_VERSION);
+    if(abi == -1)
+      abi = 0;
+  }
+  return abi;
+}
+
+bool landlock_available() {
+  return landlock_abi() > 0;
+}
+
+static __u64 handled_access(int abi) {
+  __u64 access = ACCESS_FS_V1;
+
+  if(abi >= 2)
+    access |= LANDLOCK_ACCESS_FS_REFER;
+  if(abi >= 3)
+    access |= LANDLOCK_ACCESS_FS_TRUNCATE;
+  if(abi >= 5)
+    access |= LANDLOCK_ACCESS_FS_IOCTL_DEV;
+  return access;
+}
+
+static strlist *resolve_masks(strlist *dirs) {
+  strlist *masks = strlist_new();
+  strlist_node *i;
+  struct stat st;
+  char *path;
+
+  /* Like the mount backend, only mask directories that exist */
+  for(i = strlist_first(dirs); i != NULL; i = strlist_next(i)) {
+    if( (path = realpath(strlist_val(i), NULL)) == NULL )
+      continue;
+    if( stat(path, &st) == 0 && S_ISDIR(st.st_mode) )
+      strlist_append_copy(masks, path);
+    free(path);
+  }
+  return masks;
+}
+
+static void add_rule(ruleset *r, int fd, __u64 access) {
+  struct landlock_path_beneath_attr attr;
+  struct stat st;
+
+  if( fstat(fd, &st) == -1 )
+    errExit("fstat");
+  if( !S_ISDIR(st.st_mode) )
+    access &= ACCESS_FILE;
+  attr.allowed_access = access & r->handled;
+  attr.parent_fd = fd;
+  if( attr.allowed_access == 0 )
+    return;
+  if( syscall(SYS_landlock_add_rule, r->fd, LANDLOCK_RULE_PATH_BENEATH, &attr, 0) == -1 )
+    errExit("landlock_add_rule");
+}
+
+/* Grant access to path and everything below it, except masked directories.
+ * Landlock rights are inherited by the whole hierarchy below a rule, so
+ * a directory with a masked directory somewhere below it only gets
+ * READ_DIR. Its entries get their own rules, walking down towards the
+ * masked directories. landlock_can_mask() makes sure that this only
+ * happens in read-only trees.
+ */
+static void allow_tree(ruleset *r, const char *path, __u64 access) {
+  char child[PATH_MAX];
+  struct dirent *e;
+  struct stat st;
+  DIR *d;
+  int fd;
+
+  if(has_path(r->masks, path, HAS_PARENT_OF_NEEDLE))
+    return;
+
+  if( (fd = open(path, O_PATH | O_NOFOLLOW | O_CLOEXEC)) == -1 )
+    return;
+  if(!has_path(r->masks, path, HAS_CHILD_OF_NEEDLE)) {
+    add_rule(r, fd, access);
+    close(fd);
+    return;
+  }
+  add_rule(r, fd, access & LANDLOCK_ACCESS_FS_READ_DIR);
+  close(fd);
+
+  if( (d = opendir(path)) == NULL ) {
+    errWarn("opendir");
+    return;
+  }
+  while( (e = readdir(d)) != NULL ) {
+    if( !strcmp(e->d_name, ".") || !strcmp(e->d_name, "..") )
+      continue;
+    /* Symbolic links are resolved through their targets' rules */
+    if( e->d_type == DT_LNK )
+      continue;
+    if( e->d_type == DT_UNKNOWN
+        && (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 || S_ISLNK(st.st_mode)) )
+      continue;
+    snprintf(child, PATH_MAX, "%s/%s", strcmp(path, "/") ? path : "", e->d_name);
+    allow_tree(r, child, access);
+  }
+  closedir(d);
+}
+
+static bool below_writable_path(const char *path) {
+  size_t len;
+  int i;
+
+  for(i = 0; writable_paths[i] != NULL; ++i) {
+    len = strlen(writable_paths[i]);
+    if( !strncmp(path, writable_paths[i], len) && path[len] == '/' )
+      return true;
+  }
+  return false;
+}
+
+/* Landlock cannot take rights away from a subtree. A writable parent
+ * would pass its rights to remove and create entries on to the masked
+ * directory below it, so masking is only possible in read-only trees.
+ */
+bool landlock_can_mask(const appjail_options *opts) {
+  strlist *masks = resolve_masks(opts->mask_directories);
+  strlist_node *i;
+  bool ret = true;
+
+  for(i = strlist_first(masks); i != NULL; i = strlist_next(i))
+    if( !opts->readonly || below_writable_path(strlist_val(i)) )
+      ret = false;
+  strlist_free(masks);
+  return ret;
+}
+
+void apply_landlock(const appjail_options *opts) {
+  struct landlock_ruleset_attr attr;
+  ruleset r;
+  int i;
+
+  memset(&attr, 0, sizeof(attr));
+  r.handled = attr.handled_access_fs = handled_access(landlock_abi());
+  if( (r.fd = syscall(SYS_landlock_create_ruleset, &attr, sizeof(attr), 0)) == -1 )
+    errExit("landlock_create_ruleset");
+  r.masks = resolve_masks(opts->mask_directories);
+
+  if(opts->readonly) {
+    allow_tree(&r, "/", ACCESS_READ);
+    for(i = 0; writable_paths[i] != NULL; ++i)
+      allow_tree(&r, writable_paths[i], r.handled);
+  }
+  else
+    allow_tree(&r, "/", r.handled);
+
+  /* Without no_new_privs (--allow-new-privs), restricting ourselves
+   * requires CAP_SYS_ADMIN */
+  if( prctl(PR_GET_NO_NEW_PRIVS, 0, 0, 0, 0) == 1 ) {
+    if( syscall(SYS_landlock_restrict_self, r.fd, 0) == -1 )
+      errExit("landlock_restrict_self");
+  }
+  else {
+    need_cap(CAP_SYS_ADMIN);
+    if( syscall(SYS_landlock_restrict_self, r.fd, 0) == -1 )
+      errExit("landlock_restrict_self");
+    drop_caps();
+  }
+
+  close(r.fd);
+  strlist_free(r.masks);
+}
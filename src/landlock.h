@@ -0,0 +1,7 @@
+#pragma once
+
+#include "opts.h"
+
+bool landlock_available();
+bool landlock_can_mask(const appjail_options *opts);
+void apply_landlock(const appjail_options *opts);
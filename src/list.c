@@ -1,118 +1,204 @@
 #include "list.h"
+#include "arena.h"
 #include "common.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* A list keeps its entries in one array that is terminated by a sentinel
+ * node, the strings themselves are stored in the list's arena. Removed
+ * entries stay in the array as tombstones that iteration skips. A hash
+ * index over the entries makes lookups, unique appends and removals
+ * constant time. Appending may move the nodes, so nodes must not be
+ * kept across appends.
+ */
+#define NODE_LIVE 0
+#define NODE_REMOVED 1
+#define NODE_END 2
+
+#define INDEX_EMPTY ((size_t)-1)
+#define INDEX_REMOVED ((size_t)-2)
+
 struct strlist_node {
-  char *val;
-  strlist_node *next;
+  const char *val;
+  size_t len;
+  uint32_t hash;
+  int state;
 };
 
 struct strlist {
-  strlist_node *first;
-  strlist_node *last;
+  arena *strings;
+  strlist_node *nodes;
+  /* number of nodes without the sentinel, and live nodes */
+  size_t len, count, alloc;
+  /* open addressing, slots contain node numbers */
+  size_t *index;
+  size_t index_size, index_used;
 };
 
+static uint32_t hash_string(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  size_t i;
+
+  /* FNV-1a */
+  for(i = 0; i < len; ++i) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
 strlist *strlist_new() {
   strlist *ret;
 
   if( (ret = malloc(sizeof(strlist))) == NULL )
     errExit("malloc");
-  ret->first = NULL;
-  ret->last = NULL;
+  ret->strings = arena_new();
+  ret->len = 0;
+  ret->count = 0;
+  ret->alloc = 8;
+  if( (ret->nodes = malloc((ret->alloc + 1) * sizeof(strlist_node))) == NULL )
+    errExit("malloc");
+  ret->nodes[0].state = NODE_END;
+  ret->index = NULL;
+  ret->index_size = 0;
+  ret->index_used = 0;
 
   return ret;
 }
 
 void strlist_free(strlist *l) {
-  strlist_node *cur, *next;
-
-  cur = l->first;
-  while( cur != NULL ) {
-    next = cur->next;
-    free( cur->val );
-    free( cur );
-    cur = next;
-  }
-  free( l );
+  arena_free(l->strings);
+  free(l->nodes);
+  free(l->index);
+  free(l);
 }
 
-static strlist_node *add_node(strlist *l) {
-  strlist_node *n;
+static void index_insert(strlist *l, size_t n) {
+  size_t mask = l->index_size - 1, i;
 
-  if( (n = malloc(sizeof(strlist_node))) == NULL )
+  for(i = l->nodes[n].hash & mask; l->index[i] != INDEX_EMPTY; i = (i + 1) & mask);
+  l->index[i] = n;
+  l->index_used++;
+}
+
+static void rebuild_index(strlist *l) {
+  size_t size = 16, i;
+
+  while(size < 2 * (l->count + 1))
+    size *= 2;
+  free(l->index);
+  if( (l->index = malloc(size * sizeof(size_t))) == NULL )
     errExit("malloc");
-  if( l->last == NULL ) {
-    l->first = n;
-    l->last = n;
-  }
-  else {
-    l->last->next = n;
-    l->last = n;
+  l->index_size = size;
+  l->index_used = 0;
+  for(i = 0; i < size; ++i)
+    l->index[i] = INDEX_EMPTY;
+  for(i = 0; i < l->len; ++i)
+    if(l->nodes[i].state == NODE_LIVE)
+      index_insert(l, i);
+}
+
+/* Returns the index slot of the first live entry equal to s */
+static size_t find_slot(strlist *l, const char *s, size_t len) {
+  size_t mask = l->index_size - 1, i, n, found = INDEX_EMPTY;
+  uint32_t hash;
+
+  if(l->index == NULL)
+    return INDEX_EMPTY;
+  hash = hash_string(s, len);
+  for(i = hash & mask; l->index[i] != INDEX_EMPTY; i = (i + 1) & mask) {
+    n = l->index[i];
+    if( n == INDEX_REMOVED || l->nodes[n].hash != hash || l->nodes[n].len != len
+        || memcmp(l->nodes[n].val, s, len) != 0 )
+      continue;
+    if(found == INDEX_EMPTY || n < l->index[found])
+      found = i;
   }
-  n->next = NULL;
-
-  return n;
+  return found;
 }
 
-void strlist_append(strlist *l, char *s) {
-  add_node(l)->val = s;
+void strlist_append_len(strlist *l, const char *s, size_t len) {
+  strlist_node *n;
+
+  if(l->len == l->alloc) {
+    l->alloc *= 2;
+    if( (l->nodes = realloc(l->nodes, (l->alloc + 1) * sizeof(strlist_node))) == NULL )
+      errExit("realloc");
+  }
+  if( 4 * (l->index_used + 1) > 3 * l->index_size )
+    rebuild_index(l);
+
+  n = &(l->nodes[l->len]);
+  n->val = arena_strndup(l->strings, s, len);
+  n->len = len;
+  n->hash = hash_string(s, len);
+  n->state = NODE_LIVE;
+  index_insert(l, l->len);
+  l->len++;
+  l->count++;
+  l->nodes[l->len].state = NODE_END;
 }
 
 void strlist_append_copy(strlist *l, const char *s) {
-  add_node(l)->val = strdup(s);
+  strlist_append_len(l, s, strlen(s));
 }
 
 void strlist_append_copy_unique(strlist *l, const char *s) {
-  strlist_node *n;
+  size_t len = strlen(s);
 
-  for(n = strlist_first(l); n != NULL; n = strlist_next(n))
-    if(!strcmp(strlist_val(n), s))
-      return;
-  strlist_append_copy(l, s);
+  if(find_slot(l, s, len) == INDEX_EMPTY)
+    strlist_append_len(l, s, len);
+}
+
+static strlist_node *skip_removed(strlist_node *n) {
+  while(n->state == NODE_REMOVED)
+    n++;
+  return n->state == NODE_END ? NULL : n;
 }
 
 strlist_node *strlist_first(strlist *l) {
-  return l->first;
+  return skip_removed(l->nodes);
 }
 
 strlist_node *strlist_next(strlist_node *n) {
-  return n->next;
+  return skip_removed(n + 1);
 }
 
 const char *strlist_val(strlist_node *n) {
   return n->val;
 }
 
-void strlist_remove(strlist *l, const char *s) {
-  strlist_node *cur, *prev;
+size_t strlist_count(strlist *l) {
+  return l->count;
+}
 
-  cur = strlist_first(l);
-  prev = NULL;
-  while(cur != NULL && strcmp(strlist_val(cur), s) != 0) {
-    prev = cur;
-    cur = strlist_next(cur);
-  }
-  if(cur != NULL) {
-    if(l->last == cur)
-      l->last = prev;
-    if(prev == NULL)
-      l->first = strlist_next(cur);
-    else
-      prev->next = strlist_next(cur);
-    free(cur->val);
-    free(cur);
-  }
+bool strlist_contains(strlist *l, const char *s) {
+  return find_slot(l, s, strlen(s)) != INDEX_EMPTY;
+}
+
+void strlist_remove_len(strlist *l, const char *s, size_t len) {
+  size_t slot;
+
+  if( (slot = find_slot(l, s, len)) == INDEX_EMPTY )
+    return;
+  l->nodes[l->index[slot]].state = NODE_REMOVED;
+  l->index[slot] = INDEX_REMOVED;
+  l->count--;
+}
+
+void strlist_remove(strlist *l, const char *s) {
+  strlist_remove_len(l, s, strlen(s));
 }
 
 struct intlist_node {
   int val;
-  intlist_node *next;
+  bool end;
 };
 
 struct intlist {
-  intlist_node *first;
-  intlist_node *last;
+  intlist_node *nodes;
+  size_t len, alloc;
 };
 
 intlist *intlist_new() {
@@ -120,47 +206,38 @@ intlist *intlist_new() {
 
   if( (ret = malloc(sizeof(intlist))) == NULL )
     errExit("malloc");
-  ret->first = NULL;
-  ret->last = NULL;
+  ret->len = 0;
+  ret->alloc = 8;
+  if( (ret->nodes = malloc((ret->alloc + 1) * sizeof(intlist_node))) == NULL )
+    errExit("malloc");
+  ret->nodes[0].end = true;
 
   return ret;
 }
 
 void intlist_free(intlist *l) {
-  intlist_node *cur, *next;
-
-  cur = l->first;
-  while( cur != NULL ) {
-    next = cur->next;
-    free( cur );
-    cur = next;
-  }
-  free( l );
+  free(l->nodes);
+  free(l);
 }
 
 void intlist_append(intlist *l, int i) {
-  intlist_node *n;
-
-  if( (n = malloc(sizeof(intlist_node))) == NULL )
-    errExit("malloc");
-  if( l->last == NULL ) {
-    l->first = n;
-    l->last = n;
-  }
-  else {
-    l->last->next = n;
-    l->last = n;
+  if(l->len == l->alloc) {
+    l->alloc *= 2;
+    if( (l->nodes = realloc(l->nodes, (l->alloc + 1) * sizeof(intlist_node))) == NULL )
+      errExit("realloc");
   }
-  n->next = NULL;
-  n->val = i;
+  l->nodes[l->len].val = i;
+  l->nodes[l->len].end = false;
+  l->len++;
+  l->nodes[l->len].end = true;
 }
 
 intlist_node *intlist_first(intlist *l) {
-  return l->first;
+  return l->nodes[0].end ? NULL : l->nodes;
 }
 
 intlist_node *intlist_next(intlist_node *n) {
-  return n->next;
+  return n[1].end ? NULL : n + 1;
 }
 
 int intlist_val(intlist_node *n) {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "common.h"
+
 struct strlist;
 struct strlist_node;
 
@@ -9,12 +11,15 @@ typedef struct strlist_node strlist_node;
 strlist *strlist_new();
 void strlist_free(strlist *l);
 
-void strlist_append(strlist *l, char *s);
+void strlist_append_len(strlist *l, const char *s, size_t len);
 void strlist_append_copy(strlist *l, const char *s);
 void strlist_append_copy_unique(strlist *l, const char *s);
 strlist_node *strlist_first(strlist *l);
 strlist_node *strlist_next(strlist_node *n);
 const char *strlist_val(strlist_node *n);
+size_t strlist_count(strlist *l);
+bool strlist_contains(strlist *l, const char *s);
+void strlist_remove_len(strlist *l, const char *s, size_t len);
 void strlist_remove(strlist *l, const char *s);
 
 struct intlist;
@@ -0,0 +1,123 @@
+#include "listen.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Split [ADDR]:PORT or ADDR:PORT into its parts, ADDR may be empty */
+static bool split_listen_address(const char *s, char *host, size_t hostlen, const char **port) {
+  const char *end, *colon;
+  size_t len;
+
+  if(s[0] == '[') {
+    if( (end = strchr(s, ']')) == NULL || end[1] != ':' )
+      return false;
+    s++;
+    colon = end + 1;
+    len = end - s;
+  }
+  else {
+    if( (colon = strrchr(s, ':')) == NULL )
+      return false;
+    len = colon - s;
+  }
+  if(len >= hostlen || colon[1] == '\0')
+    return false;
+  memcpy(host, s, len);
+  host[len] = '\0';
+  *port = colon + 1;
+  return true;
+}
+
+static struct addrinfo *resolve_listen_address(const char *s) {
+  struct addrinfo hints, *res;
+  char host[NI_MAXHOST];
+  const char *port;
+
+  if(!split_listen_address(s, host, sizeof(host), &port))
+    return NULL;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+  if( getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &res) != 0 )
+    return NULL;
+  return res;
+}
+
+bool is_valid_listen_address(const char *s) {
+  struct addrinfo *res;
+
+  if( (res = resolve_listen_address(s)) == NULL )
+    return false;
+  freeaddrinfo(res);
+  return true;
+}
+
+/* Bind a listening TCP socket in the caller's network namespace, it keeps
+ * accepting connections from there after it was passed into the jail */
+int open_listen_socket(const char *s) {
+  struct addrinfo *res;
+  int fd, on = 1;
+
+  if( (res = resolve_listen_address(s)) == NULL )
+    errExitNoErrno("Invalid listen address.");
+  if( (fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol)) == -1 )
+    errExit("socket");
+  if( setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 )
+    errExit("setsockopt(SO_REUSEADDR)");
+  if( bind(fd, res->ai_addr, res->ai_addrlen) == -1 ) {
+    fprintf(stderr, "Unable to bind to %s: %s\n", s, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if( listen(fd, SOMAXCONN) == -1 )
+    errExit("listen");
+  freeaddrinfo(res);
+  return fd;
+}
+
+/* Move the sockets to LISTEN_FDS_START and up, in order, and keep them
+ * open across execve(). Any other descriptor in that range is replaced.
+ */
+void pass_listen_fds(intlist *fds) {
+  intlist_node *n;
+  int count = 0, i, *high;
+
+  /* First move everything out of the way */
+  for(n = intlist_first(fds); n != NULL; n = intlist_next(n))
+    count++;
+  if( (high = malloc(count * sizeof(int))) == NULL )
+    errExit("malloc");
+  for(n = intlist_first(fds), i = 0; n != NULL; n = intlist_next(n), ++i) {
+    if( (high[i] = fcntl(intlist_val(n), F_DUPFD_CLOEXEC, LISTEN_FDS_START + count)) == -1 )
+      errExit("fcntl(F_DUPFD_CLOEXEC)");
+    close(intlist_val(n));
+  }
+  for(i = 0; i < count; ++i) {
+    /* dup2() clears the close-on-exec flag */
+    if( dup2(high[i], LISTEN_FDS_START + i) == -1 )
+      errExit("dup2");
+    close(high[i]);
+  }
+  free(high);
+}
+
+/* The variables of systemd's socket activation protocol. LISTEN_PID must
+ * be the PID of the process that uses the sockets, the init stub sets
+ * it for the command it starts. */
+void add_listen_env(strlist *set_env, intlist *fds, bool with_pid) {
+  intlist_node *n;
+  char buf[32];
+  int count = 0;
+
+  for(n = intlist_first(fds); n != NULL; n = intlist_next(n))
+    count++;
+  snprintf(buf, sizeof(buf), "LISTEN_FDS=%d", count);
+  strlist_append_copy(set_env, buf);
+  if(with_pid) {
+    snprintf(buf, sizeof(buf), "LISTEN_PID=%d", (int)getpid());
+    strlist_append_copy(set_env, buf);
+  }
+}
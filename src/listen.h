@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common.h"
+#include "list.h"
+
+/* The first file descriptor passed with the socket activation protocol */
+#define LISTEN_FDS_START 3
+
+bool is_valid_listen_address(const char *s);
+int open_listen_socket(const char *s);
+void pass_listen_fds(intlist *fds);
+void add_listen_env(strlist *set_env, intlist *fds, bool with_pid);
@@ -0,0 +1,146 @@
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* The jail writes its output into a pipe of this size. When the pipe is
+ * full, writers inside the jail block until the supervisor has caught up,
+ * so a chatty jail never makes the supervisor buffer data in memory.
+ */
+#define LOG_PIPE_SIZE (64*1024)
+
+static void open_log_file(log_output *l) {
+  struct stat st;
+
+  /* splice() refuses to write to files opened with O_APPEND,
+   * seek to the end of the file instead */
+  if( (l->fd = open(l->path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) == -1 )
+    errExit("open log file");
+  if( fstat(l->fd, &st) == -1 )
+    errExit("fstat log file");
+  if( lseek(l->fd, 0, SEEK_END) == -1 )
+    errExit("lseek log file");
+  l->size = st.st_size;
+}
+
+static void rotate_log_file(log_output *l) {
+  char from[PATH_MAX], to[PATH_MAX];
+  unsigned int i;
+
+  if( l->keep == 0 ) {
+    /* no old logs are kept, start over in the same file */
+    if( ftruncate(l->fd, 0) == -1 || lseek(l->fd, 0, SEEK_SET) == -1 )
+      errWarn("truncate log file");
+    l->size = 0;
+    return;
+  }
+
+  close(l->fd);
+  for(i = l->keep; i > 1; --i) {
+    snprintf(from, PATH_MAX-1, "%s.%u", l->path, i - 1);
+    snprintf(to, PATH_MAX-1, "%s.%u", l->path, i);
+    rename(from, to);
+  }
+  snprintf(to, PATH_MAX-1, "%s.1", l->path);
+  if( rename(l->path, to) == -1 )
+    errWarn("rename log file");
+  open_log_file(l);
+}
+
+log_output *log_output_open(const char *path, unsigned long long int max_size, unsigned int keep) {
+  log_output *l;
+
+  if( (l = malloc(sizeof(log_output))) == NULL )
+    errExit("malloc");
+  l->path = strdup(path);
+  l->max_size = max_size;
+  l->keep = keep;
+  open_log_file(l);
+
+  if( pipe2(l->pipefd, O_CLOEXEC) == -1 )
+    errExit("pipe");
+  /* The write end is inherited by the jail as stdout and stderr */
+  if( fcntl(l->pipefd[1], F_SETFD, 0) == -1 )
+    errExit("fcntl");
+  if( fcntl(l->pipefd[0], F_SETFL, O_NONBLOCK) == -1 )
+    errExit("fcntl");
+  if( fcntl(l->pipefd[0], F_SETPIPE_SZ, LOG_PIPE_SIZE) == -1 )
+    errWarn("fcntl(F_SETPIPE_SZ)");
+
+  return l;
+}
+
+void log_output_close_writer(log_output *l) {
+  if( l->pipefd[1] != -1 ) {
+    close(l->pipefd[1]);
+    l->pipefd[1] = -1;
+  }
+}
+
+static ssize_t copy_log_data(log_output *l, size_t len) {
+  char buf[4096];
+  ssize_t n, w, off;
+
+  if( len > sizeof(buf) )
+    len = sizeof(buf);
+  if( (n = read(l->pipefd[0], buf, len)) <= 0 )
+    return n;
+  for(off = 0; off < n; off += w)
+    if( (w = write(l->fd, buf + off, n - off)) == -1 )
+      return -1;
+  return n;
+}
+
+/* Move up to one pipe buffer of output into the log file without
+ * copying it through userspace. Returns false at end of file.
+ */
+bool log_output_drain(log_output *l) {
+  ssize_t n;
+  size_t len = LOG_PIPE_SIZE;
+
+  if( l->max_size > 0 ) {
+    if( l->size >= l->max_size )
+      rotate_log_file(l);
+    /* never write past the rotation boundary */
+    if( l->max_size - l->size < len )
+      len = l->max_size - l->size;
+  }
+
+  /* The read end is non-blocking while the supervisor runs its loop,
+   * splice() picks that up from the file flags */
+  n = splice(l->pipefd[0], NULL, l->fd, NULL, len, SPLICE_F_MOVE);
+  if( n == -1 && errno == EINVAL )
+    /* the file system does not support splice() */
+    n = copy_log_data(l, len);
+  if( n == -1 ) {
+    if( errno == EAGAIN || errno == EINTR )
+      return true;
+    errWarn("splice");
+    return false;
+  }
+  l->size += n;
+  return n != 0;
+}
+
+/* Messages from the supervisor itself */
+void log_output_write(log_output *l, const char *msg) {
+  int n;
+
+  if( (n = dprintf(l->fd, "%s\n", msg)) > 0 )
+    l->size += n;
+}
+
+void log_output_flush(log_output *l) {
+  if( l->pipefd[0] == -1 )
+    return;
+  /* The jail is gone, block until every remaining writer closed the pipe */
+  if( fcntl(l->pipefd[0], F_SETFL, 0) == -1 )
+    errWarn("fcntl");
+  while( log_output_drain(l) );
+  close(l->pipefd[0]);
+  l->pipefd[0] = -1;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+
+typedef struct {
+  char *path;
+  unsigned long long int max_size;
+  unsigned int keep;
+  /* current log file and its size */
+  int fd;
+  unsigned long long int size;
+  /* pipefd[1] becomes the jail's stdout and stderr,
+   * pipefd[0] is drained by the supervisor */
+  int pipefd[2];
+} log_output;
+
+log_output *log_output_open(const char *path, unsigned long long int max_size, unsigned int keep);
+void log_output_close_writer(log_output *l);
+bool log_output_drain(log_output *l);
+void log_output_write(log_output *l, const char *msg);
+void log_output_flush(log_output *l);
@@ -1,6 +1,8 @@
 #include "appjail.h"
 #include "cap.h"
+#include "cgroup.h"
 #include "initstub.h"
+#include "server.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -20,6 +22,16 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
+  /* run the launch server */
+  if(argc == 3 && !strcmp(argv[1], "--server"))
+    return server_main(argv[2]);
+
+  /* freeze or thaw a jail, this needs no privileges */
+  if(argc == 3 && (!strcmp(argv[1], "--freeze") || !strcmp(argv[1], "--thaw"))) {
+    drop_caps_forever();
+    return jail_cgroup_freeze_main(argv[2], !strcmp(argv[1], "--freeze"));
+  }
+
   /* run appjail */
   return appjail_main(argc, argv);
 }
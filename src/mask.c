@@ -1,25 +1,32 @@
 #include "mask.h"
 #include "cap.h"
+#include "landlock.h"
 #include "list_helpers.h"
+#include <errno.h>
 #include <sys/mount.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
 
+/* Only directories that we can reach are masked. The mount itself
+ * tells, it fails on missing or unreachable paths and on files that
+ * are not directories. */
 static void mask_directory(const char *dir) {
-  struct stat st;
-
-  if( stat(dir, &st) == -1 )
-    return;
-  if( !S_ISDIR(st.st_mode) )
-    return;
-  if( cap_mount("mask", dir, "tmpfs", MS_NODEV | MS_NOSUID, "size=1,mode=0755,uid=0,gid=0") == -1 )
+  if( cap_mount("mask", dir, "tmpfs", MS_NODEV | MS_NOSUID, "size=1,mode=0755,uid=0,gid=0") == -1 ) {
+    if(errno == ENOENT || errno == ENOTDIR || errno == EACCES)
+      return;
     errExit("mount -t tmpfs -o size=1,mode=0755,uid=0,gid=0 mask DIR");
+  }
 }
 
 void mask_directories(appjail_options *opts) {
   strlist_node *i;
 
+  /* The Landlock ruleset is applied at the end of the jail setup */
+  if(opts->mask_backend == MASK_LANDLOCK) {
+    if(landlock_available())
+      return;
+    fprintf(stderr, "Landlock is not available, masking directories with mounts.\n");
+    opts->mask_backend = MASK_MOUNT;
+  }
+
   for(i = strlist_first(opts->mask_directories); i != NULL; i = strlist_next(i))
     if(!has_path(opts->mask_directories, strlist_val(i), HAS_STRICT_PARENT_OF_NEEDLE))
       mask_directory(strlist_val(i));
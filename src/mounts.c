@@ -1,11 +1,29 @@
 #include "common.h"
 #include "list_helpers.h"
 #include "mounts.h"
+#include "mounttree.h"
 #include "cap.h"
 #include <sys/mount.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <string.h>
+#include <unistd.h>
 #include <libmount.h>
 
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
+/* The minimal root is assembled here before we pivot into it */
+#define MINIMAL_ROOT APPJAIL_SWAPDIR "/root"
+
 void init_libmount() {
   /* libmount setup */
   mnt_init_debug(0);
@@ -16,27 +34,18 @@ void set_mount_propagation_slave() {
     errExit("mount --make-rslave /");
 }
 
-static int error_cb(struct libmnt_table *tb, const char *filename, int line) {
-  fprintf(stderr, "Failed to parse in %s, line %d.\n", filename, line);
-  return 1;
-}
-
-static void unmount_recursive(struct libmnt_table *t, struct libmnt_fs *r) {
-  struct libmnt_iter *i = mnt_new_iter(MNT_ITER_FORWARD);
-  struct libmnt_fs *f;
+static void unmount_recursive(mount_entry *r) {
+  mount_entry *f;
 
-  while(mnt_table_next_child_fs(t, i, r, &f) == 0) {
-    unmount_recursive(t, f);
-    mnt_unref_fs(f);
-  }
-  if(cap_umount2(mnt_fs_get_target(r), 0) == -1)
+  for(f = r->first_child; f != NULL; f = f->next_sibling)
+    unmount_recursive(f);
+  if(cap_umount2(r->target, 0) == -1)
     errExit("umount");
-
-  mnt_free_iter(i);
+  mount_tree_forget(r);
 }
 
-static void unmount_or_make_private(struct libmnt_table *t, struct libmnt_fs *r, appjail_options *opts) {
-  const char *path = mnt_fs_get_target(r);
+static void unmount_or_make_private(mount_entry *r, appjail_options *opts) {
+  const char *path = r->target;
 
   if(has_path(opts->special_mounts, path, HAS_EXACT_PATH))
     return;
@@ -48,86 +57,163 @@ static void unmount_or_make_private(struct libmnt_table *t, struct libmnt_fs *r,
      && !has_path(opts->keep_mounts_full, path, HAS_PARENT_OF_NEEDLE)
      && !has_path(opts->special_mounts, path, HAS_CHILD_OF_NEEDLE)
     ) {
-    unmount_recursive(t, r);
+    unmount_recursive(r);
   }
   else {
-    struct libmnt_iter *i = mnt_new_iter(MNT_ITER_FORWARD);
-    struct libmnt_fs *f;
+    mount_entry *f;
 
     if(!has_path(opts->shared_mounts, path, HAS_PARENT_OF_NEEDLE))
       if(cap_mount(NULL, path, NULL, MS_PRIVATE, NULL) == -1)
         errExit("mount --make-private");
 
-    while(mnt_table_next_child_fs(t, i, r, &f) == 0) {
-      unmount_or_make_private(t, f, opts);
-      mnt_unref_fs(f);
-    }
-    mnt_free_iter(i);
+    for(f = r->first_child; f != NULL; f = f->next_sibling)
+      unmount_or_make_private(f, opts);
   }
 }
 
 void sanitize_mounts(appjail_options *opts) {
-  struct libmnt_fs *f;
-  struct libmnt_table *t;
+  mount_entry *f;
+  mount_tree *t;
 
-  t = mnt_new_table();
-  mnt_table_set_parser_errcb(t, error_cb);
-
-  /* parse /proc/self/mountinfo */
-  mnt_table_parse_file(t, "/proc/self/mountinfo");
+  t = mount_tree_read();
 
   /* First, handle /proc - umount /proc recursively */
-  f = mnt_table_find_mountpoint(t, "/proc", MNT_ITER_FORWARD);
-  if(f != NULL) {
-    if(!strcmp("/proc", mnt_fs_get_target(f)))
-      unmount_recursive(t, f);
-    mnt_unref_fs(f);
-  }
+  if( (f = mount_tree_find(t, "/proc")) != NULL )
+    unmount_recursive(f);
+  mount_tree_free(t);
 
   /* Mount our own local /proc - we have our own PID namespace. */
   if( cap_mount("proc", "/proc", "proc", 0, NULL) == -1)
     errExit("mount -t proc proc /proc");
 
-  /* re-read /proc/self/mountinfo */
-  mnt_reset_table(t);
-  mnt_table_parse_file(t, "/proc/self/mountinfo");
+  /* re-read the mount tree */
+  t = mount_tree_read();
+  unmount_or_make_private(mount_tree_root(t), opts);
+  mount_tree_free(t);
+}
 
-  f = NULL;
-  if((mnt_table_get_root_fs(t, &f)) != 0)
-    errExitNoErrno("Error while processing mountinfo");
-  unmount_or_make_private(t, f, opts);
-  mnt_unref_fs(f);
+static int clone_mount(const char *path, bool recursive) {
+  int fd;
 
-  /* free the libmount data */
-  mnt_unref_table(t);
+  fd = cap_open_tree(path, OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | (recursive ? AT_RECURSIVE : 0));
+  if(fd == -1)
+    errExit("open_tree");
+  return fd;
 }
 
-void unmount_directory(const char *path) {
-  struct libmnt_fs *f;
-  struct libmnt_table *t;
+static void attach_mount(int fd, const char *path) {
+  char target[PATH_MAX];
 
-  t = mnt_new_table();
-  mnt_table_set_parser_errcb(t, error_cb);
+  snprintf(target, PATH_MAX-1, MINIMAL_ROOT "%s", path);
+  if(cap_move_mount(fd, target) == -1)
+    errExit("move_mount");
+  close(fd);
+}
 
-  /* parse /proc/self/mountinfo */
-  mnt_table_parse_file(t, "/proc/self/mountinfo");
+static void make_private_unless_shared(const char *path, appjail_options *opts) {
+  char target[PATH_MAX];
 
-  /* Unmount path */
-  f = mnt_table_find_mountpoint(t, path, MNT_ITER_FORWARD);
-  if(f != NULL) {
-    if(!strcmp(path, mnt_fs_get_target(f)))
-      unmount_recursive(t, f);
-    mnt_unref_fs(f);
+  if(has_path(opts->shared_mounts, path, HAS_PARENT_OF_NEEDLE))
+    return;
+  snprintf(target, PATH_MAX-1, MINIMAL_ROOT "%s", path);
+  if(cap_mount(NULL, target, NULL, MS_PRIVATE, NULL) == -1)
+    errExit("mount --make-private");
+}
+
+static void make_clone_private(mount_entry *r, appjail_options *opts) {
+  mount_entry *f;
+
+  make_private_unless_shared(r->target, opts);
+  for(f = r->first_child; f != NULL; f = f->next_sibling)
+    make_clone_private(f, opts);
+}
+
+/* Mirrors unmount_or_make_private(): everything that would be
+ * unmounted is simply never copied into the new root.
+ */
+static void clone_kept_mounts(mount_entry *r, appjail_options *opts, int swapfd) {
+  const char *path = r->target;
+  mount_entry *f;
+
+  /* We mount our own /proc after pivoting */
+  if(!strcmp(path, "/proc"))
+    return;
+  if(!strcmp(path, APPJAIL_SWAPDIR)) {
+    attach_mount(swapfd, path);
+    return;
+  }
+  if(has_path(opts->special_mounts, path, HAS_EXACT_PATH)) {
+    attach_mount(clone_mount(path, true), path);
+    return;
+  }
+  if(has_path(opts->keep_mounts_full, path, HAS_PARENT_OF_NEEDLE)) {
+    attach_mount(clone_mount(path, true), path);
+    make_clone_private(r, opts);
+    return;
   }
 
-  /* free the libmount data */
-  mnt_unref_table(t);
+  if(
+        strcmp(path, "/")
+     && !has_path(opts->keep_mounts, path, HAS_CHILD_OF_NEEDLE)
+     && !has_path(opts->keep_mounts_full, path, HAS_CHILD_OF_NEEDLE)
+     && !has_path(opts->special_mounts, path, HAS_CHILD_OF_NEEDLE)
+    )
+    return;
+
+  attach_mount(clone_mount(path, false), path);
+  make_private_unless_shared(path, opts);
+
+  for(f = r->first_child; f != NULL; f = f->next_sibling)
+    clone_kept_mounts(f, opts, swapfd);
 }
 
-static void make_mount_read_only(struct libmnt_table *t, struct libmnt_fs *r, const appjail_options *opts) {
-  const char *path = mnt_fs_get_target(r);
-  struct libmnt_iter *i;
-  struct libmnt_fs *f;
+/* Instead of dismantling a copy of the host's mount tree, build a fresh
+ * root that only contains what the jail keeps and switch to it. The cost
+ * of this is proportional to the number of kept mounts, not to the
+ * number of mounts on the host.
+ */
+void build_minimal_root(appjail_options *opts) {
+  mount_tree *t;
+  int swapfd;
+
+  t = mount_tree_read();
+
+  /* Clone our private data before the new root is mounted inside of it */
+  swapfd = clone_mount(APPJAIL_SWAPDIR, true);
+  if(mkdir(MINIMAL_ROOT, 0755) == -1)
+    errExit("mkdir");
+
+  clone_kept_mounts(mount_tree_root(t), opts, swapfd);
+  mount_tree_free(t);
+
+  /* Stack the old root on top of the new one and detach it in one go */
+  if(chdir(MINIMAL_ROOT) == -1)
+    errExit("chdir");
+  if(cap_pivot_root(".", ".") == -1)
+    errExit("pivot_root");
+  if(cap_umount2(".", MNT_DETACH) == -1)
+    errExit("umount old root");
+  if(chdir("/") == -1 || chdir(APPJAIL_SWAPDIR) == -1)
+    errExit("chdir");
+
+  /* Mount our own local /proc - we have our own PID namespace. */
+  if( cap_mount("proc", "/proc", "proc", 0, NULL) == -1)
+    errExit("mount -t proc proc /proc");
+}
+
+void unmount_directory(const char *path) {
+  mount_entry *f;
+  mount_tree *t;
+
+  t = mount_tree_read();
+  if( (f = mount_tree_find(t, path)) != NULL )
+    unmount_recursive(f);
+  mount_tree_free(t);
+}
+
+static void make_mount_read_only(mount_entry *r, const appjail_options *opts) {
+  const char *path = r->target;
+  mount_entry *f;
 
   if( has_path(opts->special_mounts, path, HAS_EXACT_PATH)
       || !strcmp(path, "/tmp")
@@ -137,30 +223,14 @@ static void make_mount_read_only(struct libmnt_table *t, struct libmnt_fs *r, co
   if(cap_mount(NULL, path, NULL, MS_REMOUNT | MS_RDONLY | MS_BIND, NULL) == -1)
     errExit("mount -o remount,ro");
 
-  i = mnt_new_iter(MNT_ITER_FORWARD);
-  while(mnt_table_next_child_fs(t, i, r, &f) == 0) {
-    make_mount_read_only(t, f, opts);
-    mnt_unref_fs(f);
-  }
-  mnt_free_iter(i);
+  for(f = r->first_child; f != NULL; f = f->next_sibling)
+    make_mount_read_only(f, opts);
 }
 
 void make_read_only(const appjail_options *opts) {
-  struct libmnt_fs *f;
-  struct libmnt_table *t;
-
-  t = mnt_new_table();
-  mnt_table_set_parser_errcb(t, error_cb);
-
-  /* parse /proc/self/mountinfo */
-  mnt_table_parse_file(t, "/proc/self/mountinfo");
-
-  f = NULL;
-  if((mnt_table_get_root_fs(t, &f)) != 0)
-    errExitNoErrno("Error while processing mountinfo");
-  make_mount_read_only(t, f, opts);
-  mnt_unref_fs(f);
+  mount_tree *t;
 
-  /* free the libmount data */
-  mnt_unref_table(t);
+  t = mount_tree_read();
+  make_mount_read_only(mount_tree_root(t), opts);
+  mount_tree_free(t);
 }
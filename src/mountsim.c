@@ -0,0 +1,101 @@
+/* mount-sim: run the mount decisions of a jail's setup against a recorded
+ * mountinfo file. Linked with fakecap.c instead of cap.c, so nothing is
+ * mounted and no privileges are needed. Used by "make check".
+ *
+ * Usage: mount-sim [-K DIR] [-F DIR] [-S DIR] [-M DIR] [-r] [-q] MOUNTINFO
+ *
+ * -K, -F (--keep-full), -S and -M add to the lists of the appjail options
+ * of the same name, -r is --read-only. Every operation is printed to
+ * stdout, followed by the number of operations of each kind. With -q,
+ * only the numbers are printed. The CPU time goes to stderr.
+ */
+#include "common.h"
+#include "cap.h"
+#include "mask.h"
+#include "mounts.h"
+#include "mounttree.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Only the mount backend is simulated */
+bool landlock_available() {
+  return false;
+}
+
+static void usage() {
+  errExitNoErrno("Usage: mount-sim [-K DIR] [-F DIR] [-S DIR] [-M DIR] [-r] [-q] MOUNTINFO");
+}
+
+int main(int argc, char *argv[]) {
+  appjail_options *opts;
+  struct timespec start, end;
+  bool quiet = false;
+  int c;
+
+  if( (opts = calloc(1, sizeof(appjail_options))) == NULL )
+    errExit("calloc");
+  opts->keep_mounts = strlist_new();
+  opts->keep_mounts_full = strlist_new();
+  opts->shared_mounts = strlist_new();
+  opts->mask_directories = strlist_new();
+  opts->mask_backend = MASK_MOUNT;
+  /* as in parse_options() */
+  opts->special_mounts = strlist_new();
+  strlist_append_copy(opts->special_mounts, "/dev");
+  strlist_append_copy(opts->special_mounts, "/proc");
+  strlist_append_copy(opts->special_mounts, "/run");
+  strlist_append_copy(opts->special_mounts, APPJAIL_SWAPDIR);
+
+  while( (c = getopt(argc, argv, "K:F:S:M:rq")) != -1 ) {
+    switch(c) {
+      case 'K':
+        strlist_append_copy(opts->keep_mounts, optarg);
+        break;
+      case 'F':
+        strlist_append_copy(opts->keep_mounts_full, optarg);
+        break;
+      case 'S':
+        strlist_append_copy(opts->shared_mounts, optarg);
+        break;
+      case 'M':
+        strlist_append_copy(opts->mask_directories, optarg);
+        break;
+      case 'r':
+        opts->readonly = true;
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      default:
+        usage();
+    }
+  }
+  if(optind != argc - 1)
+    usage();
+
+  init_libmount();
+  mount_tree_use_mountinfo(argv[optind]);
+  cap_stats_enable(!quiet);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+
+  /* The same steps as in the jail's setup */
+  set_mount_propagation_slave();
+  sanitize_mounts(opts);
+  mask_directories(opts);
+  if(opts->readonly)
+    make_read_only(opts);
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+  cap_stats_report();
+  fprintf(stderr, "mount-sim: Used %.3f ms of CPU time.\n",
+          (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+  strlist_free(opts->keep_mounts);
+  strlist_free(opts->keep_mounts_full);
+  strlist_free(opts->shared_mounts);
+  strlist_free(opts->mask_directories);
+  strlist_free(opts->special_mounts);
+  free(opts);
+  return EXIT_SUCCESS;
+}
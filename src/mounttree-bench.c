@@ -0,0 +1,89 @@
+#include "common.h"
+#include "mounttree.h"
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <libmount.h>
+
+/* Compare mount_tree_read() with parsing all of mountinfo with libmount,
+ * in a mount namespace with COUNT extra tmpfs mounts:
+ *
+ *   make mounttree-bench
+ *   unshare -Ur ./mounttree-bench 10000
+ */
+
+static double elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static size_t count_mounts(const mount_entry *e) {
+  const mount_entry *c;
+  size_t n = 1;
+
+  for(c = e->first_child; c != NULL; c = c->next_sibling)
+    n += count_mounts(c);
+  return n;
+}
+
+static void add_mounts(unsigned int count) {
+  char base[] = "/tmp/mounttree-bench.XXXXXX", dir[64];
+  unsigned int i;
+
+  if( unshare(CLONE_NEWNS) == -1 )
+    errExit("unshare, run this as root or with unshare -Ur");
+  if( mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) == -1 )
+    errExit("mount --make-rprivate /");
+  if( mkdtemp(base) == NULL )
+    errExit("mkdtemp");
+  if( mount("bench", base, "tmpfs", 0, NULL) == -1 )
+    errExit("mount");
+  for(i = 0; i < count; ++i) {
+    snprintf(dir, sizeof(dir), "%s/%u", base, i);
+    if( mkdir(dir, 0700) == -1 )
+      errExit("mkdir");
+    if( mount("bench", dir, "tmpfs", 0, "size=4k") == -1 )
+      errExit("mount");
+  }
+  /* The mounts vanish with the namespace, only the directory is left */
+  rmdir(base);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int count = 10000, rounds = 20, i;
+  struct libmnt_table *tb;
+  struct timespec start;
+  mount_tree *t;
+  size_t mounts = 0;
+  double ms;
+
+  if( (argc > 1 && !string_to_unsigned_integer(&count, argv[1]))
+      || (argc > 2 && (!string_to_unsigned_integer(&rounds, argv[2]) || rounds == 0)) )
+    errExitNoErrno("Usage: mounttree-bench [COUNT] [ROUNDS]");
+  add_mounts(count);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < rounds; ++i) {
+    t = mount_tree_read();
+    mounts = count_mounts(mount_tree_root(t));
+    mount_tree_free(t);
+  }
+  ms = elapsed(&start) / rounds;
+  printf("mount_tree_read:      %8.2f ms (%zu mounts)\n", ms, mounts);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < rounds; ++i) {
+    tb = mnt_new_table();
+    mnt_table_parse_file(tb, "/proc/self/mountinfo");
+    mnt_unref_table(tb);
+  }
+  ms = elapsed(&start) / rounds;
+  printf("mnt_table_parse_file: %8.2f ms\n", ms);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,338 @@
+#include "mounttree.h"
+#include "arena.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <libmount.h>
+
+#ifndef SYS_statmount
+#define SYS_statmount 457
+#endif
+#ifndef SYS_listmount
+#define SYS_listmount 458
+#endif
+#ifndef STATX_MNT_ID_UNIQUE
+#define STATX_MNT_ID_UNIQUE 0x00004000U
+#endif
+#define STATMOUNT_MNT_BASIC 0x00000002U
+#define STATMOUNT_MNT_POINT 0x00000010U
+#define MNT_ID_REQ_SIZE_VER0 24
+
+/* struct mnt_id_req and struct statmount from linux/mount.h, which
+ * only newer kernel headers have */
+struct mount_id_req {
+  uint32_t size;
+  uint32_t spare;
+  uint64_t mnt_id;
+  uint64_t param;
+};
+
+struct mount_stat {
+  uint32_t size;
+  uint32_t mnt_opts;
+  uint64_t mask;
+  uint32_t sb_dev_major;
+  uint32_t sb_dev_minor;
+  uint64_t sb_magic;
+  uint32_t sb_flags;
+  uint32_t fs_type;
+  uint64_t mnt_id;
+  uint64_t mnt_parent_id;
+  uint32_t mnt_id_old;
+  uint32_t mnt_parent_id_old;
+  uint64_t mnt_attr;
+  uint64_t mnt_propagation;
+  uint64_t mnt_peer_group;
+  uint64_t mnt_master;
+  uint64_t propagate_from;
+  uint32_t mnt_root;
+  uint32_t mnt_point;
+  uint64_t spare2[50];
+  char str[];
+};
+
+/* While the tree is read, entries refer to their parent by index,
+ * the entry array moves when it grows */
+typedef struct {
+  uint64_t id;
+  uint64_t parent_id;
+  const char *target;
+  size_t parent;
+} raw_entry;
+
+#define NO_PARENT ((size_t)-1)
+
+struct mount_tree {
+  arena *strings;
+  mount_entry *entries;
+  size_t count;
+  /* only used while reading */
+  raw_entry *raw;
+  size_t size;
+};
+
+static void add_entry(mount_tree *t, uint64_t id, uint64_t parent_id, const char *target, size_t parent) {
+  if(t->count == t->size) {
+    t->size = t->size == 0 ? 64 : 2 * t->size;
+    if( (t->raw = realloc(t->raw, t->size * sizeof(raw_entry))) == NULL )
+      errExit("realloc");
+  }
+  t->raw[t->count].id = id;
+  t->raw[t->count].parent_id = parent_id;
+  t->raw[t->count].target = arena_strndup(t->strings, target, strlen(target));
+  t->raw[t->count].parent = parent;
+  t->count++;
+}
+
+/* Fetch only the parent and the mount point of a mount */
+static bool stat_mount(uint64_t id, struct mount_stat **sm, size_t *size) {
+  struct mount_id_req req;
+
+  memset(&req, 0, sizeof(req));
+  req.size = MNT_ID_REQ_SIZE_VER0;
+  req.mnt_id = id;
+  req.param = STATMOUNT_MNT_BASIC | STATMOUNT_MNT_POINT;
+  while( syscall(SYS_statmount, &req, *sm, *size, 0) == -1 ) {
+    if(errno != EOVERFLOW)
+      return false;
+    *size *= 2;
+    if( (*sm = realloc(*sm, *size)) == NULL )
+      errExit("realloc");
+  }
+  return true;
+}
+
+/* The listing position of a mount, to look up parents by ID */
+typedef struct {
+  uint64_t id;
+  size_t index;
+} id_index;
+
+static int compare_id(const void *a, const void *b) {
+  uint64_t x = ((const id_index*)a)->id, y = ((const id_index*)b)->id;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Newer kernels list the whole subtree below a mount. Look up the
+ * parents in the listing then, through a sorted copy of the IDs so
+ * the entries stay in listing order. */
+static void resolve_parents(mount_tree *t) {
+  id_index key, *ids, *found;
+  size_t i;
+
+  if( (ids = malloc(t->count * sizeof(id_index))) == NULL )
+    errExit("malloc");
+  for(i = 0; i < t->count; ++i) {
+    ids[i].id = t->raw[i].id;
+    ids[i].index = i;
+  }
+  qsort(ids, t->count, sizeof(id_index), compare_id);
+  for(i = 1; i < t->count; ++i) {
+    key.id = t->raw[i].parent_id;
+    if( (found = bsearch(&key, ids, t->count, sizeof(id_index), compare_id)) != NULL )
+      t->raw[i].parent = found->index;
+    else
+      /* the parent is gone, so is the mount */
+      t->raw[i].parent = NO_PARENT;
+  }
+  free(ids);
+}
+
+/* List the mounts below our root by ID and fetch what we need for each.
+ * Returns false if the kernel does not support listmount() and
+ * statmount().
+ */
+static bool read_listmount(mount_tree *t) {
+  struct statx stx;
+  struct mount_id_req req;
+  struct mount_stat *sm;
+  uint64_t ids[512];
+  size_t size = sizeof(struct mount_stat) + 4096, i;
+  bool subtree = false;
+  long n, j;
+
+  if( statx(AT_FDCWD, "/", 0, STATX_MNT_ID_UNIQUE, &stx) == -1 || !(stx.stx_mask & STATX_MNT_ID_UNIQUE) )
+    return false;
+  if( (sm = malloc(size)) == NULL )
+    errExit("malloc");
+  /* probe for statmount() */
+  if(!stat_mount(stx.stx_mnt_id, &sm, &size)) {
+    free(sm);
+    return false;
+  }
+  add_entry(t, stx.stx_mnt_id, 0, "/", NO_PARENT);
+
+  /* Older kernels only list the children of a mount, walk the tree
+   * breadth-first then. Once a listing contains a grandchild, the
+   * first listing already had the whole tree. */
+  for(i = 0; i < t->count && !subtree; ++i) {
+    memset(&req, 0, sizeof(req));
+    req.size = MNT_ID_REQ_SIZE_VER0;
+    req.mnt_id = t->raw[i].id;
+    do {
+      if( (n = syscall(SYS_listmount, &req, ids, sizeof(ids)/sizeof(ids[0]), 0)) == -1 )
+        errExit("listmount");
+      for(j = 0; j < n; ++j) {
+        if(!stat_mount(ids[j], &sm, &size)) {
+          /* unmounted on the host in the meantime */
+          if(errno == ENOENT)
+            continue;
+          errExit("statmount");
+        }
+        if(sm->mnt_parent_id != t->raw[i].id)
+          subtree = true;
+        add_entry(t, sm->mnt_id, sm->mnt_parent_id, sm->str + sm->mnt_point, i);
+      }
+      /* continue after the last ID we got */
+      if(n > 0)
+        req.param = ids[n-1];
+    } while(n == sizeof(ids)/sizeof(ids[0]));
+  }
+  if(subtree)
+    resolve_parents(t);
+
+  free(sm);
+  return true;
+}
+
+static int error_cb(struct libmnt_table *tb, const char *filename, int line) {
+  fprintf(stderr, "Failed to parse in %s, line %d.\n", filename, line);
+  return 1;
+}
+
+/* A recorded mountinfo file that is read instead of our own mounts,
+ * and the sorted IDs of the mounts that were unmounted from it */
+static const char *mountinfo_file = NULL;
+static uint64_t *forgotten = NULL;
+static size_t num_forgotten = 0, size_forgotten = 0;
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void add_libmount_children(mount_tree *t, struct libmnt_table *tb, struct libmnt_fs *r, size_t parent) {
+  struct libmnt_iter *i = mnt_new_iter(MNT_ITER_FORWARD);
+  struct libmnt_fs *f;
+  uint64_t id;
+  size_t idx;
+
+  while(mnt_table_next_child_fs(tb, i, r, &f) == 0) {
+    id = mnt_fs_get_id(f);
+    if( num_forgotten > 0 && bsearch(&id, forgotten, num_forgotten, sizeof(uint64_t), compare_u64) != NULL ) {
+      mnt_unref_fs(f);
+      continue;
+    }
+    idx = t->count;
+    add_entry(t, mnt_fs_get_id(f), mnt_fs_get_parent_id(f), mnt_fs_get_target(f), parent);
+    add_libmount_children(t, tb, f, idx);
+    mnt_unref_fs(f);
+  }
+  mnt_free_iter(i);
+}
+
+/* Older kernels: parse /proc/self/mountinfo */
+static void read_libmount(mount_tree *t, const char *mountinfo) {
+  struct libmnt_table *tb;
+  struct libmnt_fs *f = NULL;
+
+  tb = mnt_new_table();
+  mnt_table_set_parser_errcb(tb, error_cb);
+  mnt_table_parse_file(tb, mountinfo);
+
+  if((mnt_table_get_root_fs(tb, &f)) != 0)
+    errExitNoErrno("Error while processing mountinfo");
+  add_entry(t, mnt_fs_get_id(f), mnt_fs_get_parent_id(f), mnt_fs_get_target(f), NO_PARENT);
+  add_libmount_children(t, tb, f, 0);
+  mnt_unref_fs(f);
+
+  mnt_unref_table(tb);
+}
+
+void mount_tree_use_mountinfo(const char *path) {
+  mountinfo_file = path;
+}
+
+/* The mounts of a recorded mountinfo file cannot be unmounted, leave
+ * them out when the file is read again */
+void mount_tree_forget(const mount_entry *e) {
+  if(mountinfo_file == NULL)
+    return;
+  if(num_forgotten == size_forgotten) {
+    size_forgotten = size_forgotten == 0 ? 64 : 2 * size_forgotten;
+    if( (forgotten = realloc(forgotten, size_forgotten * sizeof(uint64_t))) == NULL )
+      errExit("realloc");
+  }
+  forgotten[num_forgotten++] = e->id;
+}
+
+mount_tree *mount_tree_read() {
+  static bool use_libmount = false;
+  mount_tree *t;
+  mount_entry *e, **last;
+  size_t i;
+
+  if( (t = malloc(sizeof(mount_tree))) == NULL )
+    errExit("malloc");
+  t->strings = arena_new();
+  t->raw = NULL;
+  t->count = t->size = 0;
+
+  if(mountinfo_file != NULL) {
+    qsort(forgotten, num_forgotten, sizeof(uint64_t), compare_u64);
+    read_libmount(t, mountinfo_file);
+  }
+  else if(use_libmount || !read_listmount(t)) {
+    use_libmount = true;
+    t->count = 0;
+    read_libmount(t, "/proc/self/mountinfo");
+  }
+
+  /* Link the entries, children keep the order in which they were read */
+  if( (t->entries = calloc(t->count, sizeof(mount_entry))) == NULL
+      || (last = calloc(t->count, sizeof(mount_entry*))) == NULL )
+    errExit("calloc");
+  for(i = 0; i < t->count; ++i) {
+    e = &(t->entries[i]);
+    e->id = t->raw[i].id;
+    e->target = t->raw[i].target;
+    if(t->raw[i].parent == NO_PARENT)
+      continue;
+    e->parent = &(t->entries[t->raw[i].parent]);
+    if(last[t->raw[i].parent] == NULL)
+      e->parent->first_child = e;
+    else
+      last[t->raw[i].parent]->next_sibling = e;
+    last[t->raw[i].parent] = e;
+  }
+  free(last);
+  free(t->raw);
+  t->raw = NULL;
+
+  return t;
+}
+
+void mount_tree_free(mount_tree *t) {
+  arena_free(t->strings);
+  free(t->entries);
+  free(t);
+}
+
+mount_entry *mount_tree_root(mount_tree *t) {
+  return &(t->entries[0]);
+}
+
+/* The first mount on target, mounts stacked on top of it are its children */
+mount_entry *mount_tree_find(mount_tree *t, const char *target) {
+  size_t i;
+
+  for(i = 0; i < t->count; ++i)
+    if(!strcmp(t->entries[i].target, target))
+      return &(t->entries[i]);
+  return NULL;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common.h"
+#include <stdint.h>
+
+/* A snapshot of the mount tree, as seen from our root directory */
+typedef struct mount_entry {
+  uint64_t id;
+  const char *target;
+  struct mount_entry *parent;
+  struct mount_entry *first_child;
+  struct mount_entry *next_sibling;
+} mount_entry;
+
+struct mount_tree;
+typedef struct mount_tree mount_tree;
+
+void mount_tree_use_mountinfo(const char *path);
+void mount_tree_forget(const mount_entry *e);
+mount_tree *mount_tree_read();
+void mount_tree_free(mount_tree *t);
+mount_entry *mount_tree_root(mount_tree *t);
+mount_entry *mount_tree_find(mount_tree *t, const char *target);
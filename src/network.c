@@ -1,10 +1,16 @@
 #include "network.h"
 #include "cap.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
 #include <net/if.h>
+#include <linux/if_link.h>
 #include <netlink/route/addr.h>
 #include <netlink/addr.h>
 #include <netlink/cache.h>
 #include <netlink/route/link.h>
+#include <netlink/route/link/ipvlan.h>
+#include <netlink/route/route.h>
 
 int configure_loopback_interface() {
   struct nl_sock *sock = NULL;
@@ -113,3 +119,210 @@ out2:
 
   return ret;
 }
+
+bool is_valid_address(const char *s) {
+  struct nl_addr *addr;
+
+  if(nl_addr_parse(s, AF_UNSPEC, &addr) < 0)
+    return false;
+  nl_addr_put(addr);
+  return true;
+}
+
+/* Check that the address in S (ADDR/PREFIX) lies in one of the
+ * NETWORKS. Only the address counts, not the prefix length the jail
+ * assigns to its interface.
+ */
+bool is_allowed_address(const char *s, strlist *networks) {
+  struct nl_addr *addr, *net;
+  strlist_node *n;
+  bool ret = false;
+
+  if(nl_addr_parse(s, AF_UNSPEC, &addr) < 0)
+    return false;
+  /* nl_addr_cmp_prefix() compares the shorter of both prefixes */
+  nl_addr_set_prefixlen(addr, nl_addr_get_len(addr) * 8);
+  for(n = strlist_first(networks); n != NULL && !ret; n = strlist_next(n)) {
+    if(nl_addr_parse(strlist_val(n), AF_UNSPEC, &net) < 0)
+      continue;
+    ret = nl_addr_get_family(addr) == nl_addr_get_family(net) && nl_addr_cmp_prefix(addr, net) == 0;
+    nl_addr_put(net);
+  }
+  nl_addr_put(addr);
+  return ret;
+}
+
+/* Create a new network namespace that contains an ipvlan interface on
+ * the host's device parent. Creating the interface right inside the
+ * namespace avoids moving it there after the jail was cloned, the jail
+ * only has to join the namespace. Returns a file descriptor for the
+ * namespace.
+ */
+int create_ipvlan_namespace(const char *parent) {
+  struct nl_sock *sock = NULL;
+  struct nl_cache *cache = NULL;
+  struct rtnl_link *link = NULL;
+  int hostfd, nsfd, ifindex, err;
+
+  need_cap(CAP_SYS_ADMIN);
+  if( (hostfd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC)) == -1 )
+    errExit("open /proc/self/ns/net");
+  if( unshare(CLONE_NEWNET) == -1 )
+    errExit("unshare(CLONE_NEWNET)");
+  if( (nsfd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC)) == -1 )
+    errExit("open /proc/self/ns/net");
+  if( setns(hostfd, CLONE_NEWNET) == -1 )
+    errExit("setns");
+  close(hostfd);
+  drop_caps();
+
+  need_cap(CAP_NET_ADMIN);
+  if( (sock = nl_socket_alloc()) == NULL )
+    errExit("nl_socket_alloc");
+  if( (err = nl_connect(sock, NETLINK_ROUTE)) < 0 ) {
+    fprintf(stderr, "Unable to connect to netlink: %s\n", nl_geterror(err));
+    exit(EXIT_FAILURE);
+  }
+  if( (err = rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache)) < 0 ) {
+    fprintf(stderr, "Unable to get the network interfaces: %s\n", nl_geterror(err));
+    exit(EXIT_FAILURE);
+  }
+  if( (ifindex = rtnl_link_name2i(cache, parent)) == 0 ) {
+    fprintf(stderr, "Network interface %s does not exist.\n", parent);
+    exit(EXIT_FAILURE);
+  }
+  if( (link = rtnl_link_ipvlan_alloc()) == NULL )
+    errExitNoErrno("rtnl_link_ipvlan_alloc");
+  /* In L2 mode, the jail resolves its neighbours itself and the usual
+   * gateway setup works */
+  rtnl_link_ipvlan_set_mode(link, IPVLAN_MODE_L2);
+  rtnl_link_set_link(link, ifindex);
+  rtnl_link_set_name(link, IPVLAN_INTERFACE);
+  rtnl_link_set_ns_fd(link, nsfd);
+  if( (err = rtnl_link_add(sock, link, NLM_F_CREATE | NLM_F_EXCL)) < 0 ) {
+    fprintf(stderr, "Unable to create ipvlan interface on %s: %s\n", parent, nl_geterror(err));
+    exit(EXIT_FAILURE);
+  }
+
+  rtnl_link_put(link);
+  nl_cache_put(cache);
+  nl_close(sock);
+  nl_socket_free(sock);
+  drop_caps();
+
+  return nsfd;
+}
+
+void join_network_namespace(int fd) {
+  need_cap(CAP_SYS_ADMIN);
+  if( setns(fd, CLONE_NEWNET) == -1 )
+    errExit("setns");
+  drop_caps();
+  close(fd);
+}
+
+/* Bring up the ipvlan interface with an optional address and default
+ * route. Must run in the jail's network namespace. */
+int configure_ipvlan_interface(const char *address, const char *gateway) {
+  struct nl_sock *sock = NULL;
+  struct nl_cache *cache = NULL;
+  struct rtnl_link *link = NULL, *change = NULL;
+  struct rtnl_addr *addr = NULL;
+  struct rtnl_route *route = NULL;
+  struct rtnl_nexthop *nh = NULL;
+  struct nl_addr *local = NULL, *gw = NULL, *dst = NULL;
+  int err, ifindex, ret = -1;
+
+  if(!want_cap(CAP_NET_ADMIN)) {
+    errWarn("Cannot set the CAP_NET_ADMIN effective capability");
+    return -1;
+  }
+
+  if( (sock = nl_socket_alloc()) == NULL ) {
+    errWarn("nl_socket_alloc");
+    drop_caps();
+    return -1;
+  }
+  if( (err = nl_connect(sock, NETLINK_ROUTE)) < 0 ) {
+    fprintf(stderr, "Unable to connect to netlink: %s\n", nl_geterror(err));
+    goto out2;
+  }
+  if( rtnl_link_alloc_cache(sock, AF_UNSPEC, &cache) < 0 )
+    goto out;
+  if( (link = rtnl_link_get_by_name(cache, IPVLAN_INTERFACE)) == NULL )
+    goto out;
+  ifindex = rtnl_link_get_ifindex(link);
+
+  if(address != NULL) {
+    if( (addr = rtnl_addr_alloc()) == NULL )
+      goto out;
+    if( (err = nl_addr_parse(address, AF_UNSPEC, &local)) < 0
+        || (err = rtnl_addr_set_local(addr, local)) < 0 ) {
+      fprintf(stderr, "Unable to set address: %s\n", nl_geterror(err));
+      goto out;
+    }
+    rtnl_addr_set_link(addr, link);
+    rtnl_addr_set_family(addr, nl_addr_get_family(local));
+    if( (err = rtnl_addr_add(sock, addr, NLM_F_CREATE)) < 0 ) {
+      fprintf(stderr, "Unable to add address: %s\n", nl_geterror(err));
+      goto out;
+    }
+  }
+
+  if( (change = rtnl_link_alloc()) == NULL )
+    goto out;
+  rtnl_link_set_flags(change, IFF_UP);
+  if( (err = rtnl_link_change(sock, link, change, 0)) < 0 ) {
+    fprintf(stderr, "Unable to change link: %s\n", nl_geterror(err));
+    goto out;
+  }
+
+  if(gateway != NULL) {
+    if( (err = nl_addr_parse(gateway, AF_UNSPEC, &gw)) < 0
+        || (err = nl_addr_parse("default", nl_addr_get_family(gw), &dst)) < 0 ) {
+      fprintf(stderr, "Unable to parse gateway: %s\n", nl_geterror(err));
+      goto out;
+    }
+    if( (route = rtnl_route_alloc()) == NULL || (nh = rtnl_route_nh_alloc()) == NULL )
+      goto out;
+    rtnl_route_set_family(route, nl_addr_get_family(gw));
+    rtnl_route_set_dst(route, dst);
+    rtnl_route_nh_set_gateway(nh, gw);
+    rtnl_route_nh_set_ifindex(nh, ifindex);
+    /* the route owns the next hop now */
+    rtnl_route_add_nexthop(route, nh);
+    nh = NULL;
+    if( (err = rtnl_route_add(sock, route, NLM_F_CREATE)) < 0 ) {
+      fprintf(stderr, "Unable to add default route: %s\n", nl_geterror(err));
+      goto out;
+    }
+  }
+  ret = 0;
+
+out:
+  if(nh != NULL)
+    rtnl_route_nh_free(nh);
+  if(route != NULL)
+    rtnl_route_put(route);
+  if(dst != NULL)
+    nl_addr_put(dst);
+  if(gw != NULL)
+    nl_addr_put(gw);
+  if(local != NULL)
+    nl_addr_put(local);
+  if(addr != NULL)
+    rtnl_addr_put(addr);
+  if(change != NULL)
+    rtnl_link_put(change);
+  if(link != NULL)
+    rtnl_link_put(link);
+  if(cache != NULL)
+    nl_cache_put(cache);
+  nl_close(sock);
+out2:
+  nl_socket_free(sock);
+
+  drop_caps();
+
+  return ret;
+}
@@ -1,3 +1,14 @@
 #pragma once
 
+#include "common.h"
+#include "list.h"
+
+/* name of the ipvlan interface inside the jail */
+#define IPVLAN_INTERFACE "eth0"
+
 int configure_loopback_interface();
+bool is_valid_address(const char *s);
+bool is_allowed_address(const char *s, strlist *networks);
+int create_ipvlan_namespace(const char *parent);
+void join_network_namespace(int fd);
+int configure_ipvlan_interface(const char *address, const char *gateway);
@@ -1,7 +1,21 @@
 #include "notify.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+/* sd_notify() messages are short, longer ones are truncated */
+#define NOTIFY_MESSAGE_SIZE 4096
+
+/* Only these assignments are passed on to the caller, everything
+ * else (MAINPID, FDSTORE, ...) refers to the jail's own processes */
+static const char *forwarded[] = {
+  "READY=", "STATUS=", "RELOADING=", "STOPPING=", "ERRNO=", "MONOTONIC_USEC=", NULL
+};
 
 void signal_mainpid(int pipefd) {
   uint8_t u;
@@ -13,3 +27,148 @@ void signal_mainpid(int pipefd) {
     exit(EXIT_FAILURE);
   close(pipefd);
 }
+
+/* Connect to the socket in our own NOTIFY_SOCKET, if we have one. A
+ * leading @ refers to the abstract namespace. */
+static int open_caller_socket() {
+  struct sockaddr_un addr;
+  const char *path;
+  socklen_t len;
+  int fd;
+
+  path = getenv("NOTIFY_SOCKET");
+  if( path == NULL || (path[0] != '/' && path[0] != '@') )
+    return -1;
+  if( strlen(path) >= sizeof(addr.sun_path) ) {
+    fprintf(stderr, APPLICATION_NAME ": NOTIFY_SOCKET is too long, not forwarding notifications.\n");
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  len = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+  if( path[0] == '@' )
+    addr.sun_path[0] = '\0';
+  else
+    len++;
+
+  if( (fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) == -1 )
+    errExit("socket");
+  if( connect(fd, (struct sockaddr*)&addr, len) == -1 ) {
+    errWarn("connect to NOTIFY_SOCKET");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Create the socket for the jail's notifications. It is bound inside
+ * the jail by notify_bind(), the TIMEOUT in seconds starts now. With
+ * FORWARD, the messages are passed on to our own NOTIFY_SOCKET. */
+notify_socket *notify_open(unsigned int timeout, bool forward) {
+  struct itimerspec its;
+  notify_socket *n;
+
+  if( (n = malloc(sizeof(notify_socket))) == NULL )
+    errExit("malloc");
+  if( (n->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) == -1 )
+    errExit("socket");
+  n->forwardfd = forward ? open_caller_socket() : -1;
+  n->timeout = timeout;
+  n->ready = false;
+  n->timed_out = false;
+
+  n->timerfd = -1;
+  if( timeout > 0 ) {
+    if( (n->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1 )
+      errExit("timerfd_create");
+    its.it_value.tv_sec = timeout;
+    its.it_value.tv_nsec = 0;
+    its.it_interval.tv_sec = its.it_interval.tv_nsec = 0;
+    if( timerfd_settime(n->timerfd, 0, &its, NULL) == -1 )
+      errExit("timerfd_settime");
+  }
+
+  return n;
+}
+
+/* Called in the jail. The socket is shared with the supervisor, which
+ * receives everything sent to PATH from now on. */
+void notify_bind(int fd, const char *path) {
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  unlink(path);
+  if( bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 )
+    errExit("bind " APPJAIL_NOTIFY_SOCKET);
+  close(fd);
+}
+
+static bool is_forwarded(const char *line) {
+  int i;
+
+  for(i = 0; forwarded[i] != NULL; ++i)
+    if( !strncmp(line, forwarded[i], strlen(forwarded[i])) )
+      return true;
+  return false;
+}
+
+/* Receive one message from the jail and forward it to the caller.
+ * Returns true when the jail just became ready. STATUS is set to the
+ * message's STATUS= text, or an empty string.
+ */
+bool notify_receive(notify_socket *n, char *status, size_t size) {
+  char msg[NOTIFY_MESSAGE_SIZE], out[NOTIFY_MESSAGE_SIZE + 1], *line, *saveptr;
+  bool became_ready = false;
+  size_t len = 0;
+  ssize_t r;
+
+  status[0] = '\0';
+  if( (r = recv(n->fd, msg, sizeof(msg) - 1, MSG_DONTWAIT)) <= 0 )
+    return false;
+  msg[r] = '\0';
+
+  for(line = strtok_r(msg, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+    if( !is_forwarded(line) )
+      continue;
+    if( !strcmp(line, "READY=1") && !n->ready ) {
+      n->ready = became_ready = true;
+      if( n->timerfd != -1 ) {
+        close(n->timerfd);
+        n->timerfd = -1;
+      }
+    }
+    else if( !strncmp(line, "STATUS=", strlen("STATUS=")) )
+      snprintf(status, size, "%s", line + strlen("STATUS="));
+    len += snprintf(out + len, sizeof(out) - len, "%s\n", line);
+  }
+
+  if( n->forwardfd != -1 && len > 0 )
+    send(n->forwardfd, out, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  return became_ready;
+}
+
+/* Called when the timer expired. Returns true if the jail is still not ready. */
+bool notify_timeout(notify_socket *n) {
+  uint64_t expirations;
+
+  if( read(n->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations) )
+    return false;
+  close(n->timerfd);
+  n->timerfd = -1;
+  if( n->ready )
+    return false;
+  n->timed_out = true;
+  return true;
+}
+
+void notify_close(notify_socket *n) {
+  close(n->fd);
+  if( n->timerfd != -1 )
+    close(n->timerfd);
+  if( n->forwardfd != -1 )
+    close(n->forwardfd);
+  free(n);
+}
@@ -1,3 +1,26 @@
 #pragma once
 
+#include "common.h"
+
+/* The socket a --notify-ready jail sends its sd_notify() messages to */
+#define APPJAIL_NOTIFY_SOCKET "/tmp/.appjail-notify"
+
+typedef struct {
+  /* receives the jail's messages, bound inside the jail */
+  int fd;
+  /* expires when the jail did not become ready in time, or -1 */
+  int timerfd;
+  unsigned int timeout;
+  /* forwards the messages to the caller's NOTIFY_SOCKET, or -1 */
+  int forwardfd;
+  bool ready;
+  bool timed_out;
+} notify_socket;
+
 void signal_mainpid();
+
+notify_socket *notify_open(unsigned int timeout, bool forward);
+void notify_bind(int fd, const char *path);
+bool notify_receive(notify_socket *n, char *status, size_t size);
+bool notify_timeout(notify_socket *n);
+void notify_close(notify_socket *n);
@@ -1,11 +1,14 @@
 #include "common.h"
 #include "opts.h"
+#include "list_helpers.h"
+#include "landlock.h"
+#include "listen.h"
+#include "network.h"
 #include <getopt.h>
 #include <string.h>
-#include <pwd.h>
-#include <errno.h>
 #include <unistd.h>
 #include <limits.h>
+#include <sys/stat.h>
 
 #define NUM_ENTRIES 10
 
@@ -22,32 +25,98 @@ static void version() {
 
 static void usage() {
   printf("Usage: appjail [OPTIONS] [COMMAND]\n"
+         "       appjail --server <SOCKET>\n"
+         "       appjail --freeze|--thaw <PID>\n"
          "\n"
          "Start COMMAND in an isolated environment. If COMMAND is not given, it is set to '/bin/sh -i'.\n"
+         "With --server, accept launch requests on the unix socket SOCKET instead.\n"
+         "With --freeze or --thaw, stop or resume all processes of the jail that contains the process\n"
+         "PID. The jail must run in its own cgroup.\n"
          "\n"
          "Options:\n"
          "  -h, --help               Print command help and exit.\n"
          "  -v, --version            Print version information and exit.\n"
          "  -d, --daemonize          Run the jailed process in the background.\n"
          "  --keep-output            Do not close stdout/stderr in --daemonize mode.\n"
+         "  --log-output <FILE>      Write stdout/stderr to FILE in --daemonize mode.\n"
+         "  --log-max-size <SZ>      Rotate the log file when it reaches SZ bytes (default: 10M).\n"
+         "                           The suffixes K, M or G are allowed, 0 disables rotation.\n"
+         "  --log-keep <N>           Keep N rotated log files (default: 5).\n"
+         "  --notify-ready           Give the jail a private NOTIFY_SOCKET and pass its READY=1 and\n"
+         "                           STATUS= messages on to our own NOTIFY_SOCKET. In --daemonize mode,\n"
+         "                           exit once the jail sends READY=1 instead of after its setup.\n"
+         "  --notify-timeout <SECONDS>\n"
+         "                           Terminate the jail and fail if it is not ready within SECONDS\n"
+         "                           (default: 90). 0 waits forever.\n"
+         "  --event-log <DEST>       Append the jail's lifecycle events (spawn, initialized, exec,\n"
+         "                           signal, exit) to DEST as lines of JSON. DEST is a file, or\n"
+         "                           unix:PATH to send each event as a datagram to a unix socket.\n"
+         "  --setup-stats            Print how many privileged operations (mount, umount2, chown,\n"
+         "                           mknod, capset, ...) setting up the jail took, and their time.\n"
+         "  --setup-trace            Like --setup-stats, also print every operation with its target\n"
+         "                           path and latency.\n"
+         "  --pressure <RES:STALL:WINDOW>\n"
+         "                           Run the jail in its own cgroup and watch its pressure stall\n"
+         "                           information. RES is cpu, memory or io. The trigger fires when\n"
+         "                           tasks were stalled for STALL milliseconds within any WINDOW\n"
+         "                           milliseconds (500 to 10000). May be given multiple times.\n"
+         "  --pressure-action <ACTION>\n"
+         "                           Determine what happens when a pressure trigger fires.\n"
+         "                            log:  Print a message (default)\n"
+         "                            term: Also send SIGTERM to the jail\n"
+         "                            kill: Also kill the jail\n"
+         "  --cgroup                 Run the jail in its own cgroup, so it can be frozen. This is\n"
+         "                           implied by --pressure and --reclaim-idle.\n"
+         "  --reclaim-idle <SECONDS> Run the jail in its own cgroup and push its memory out to swap\n"
+         "                           or the file system once it has not used the CPU for SECONDS.\n"
          "  -i, --initstub           Run a stub init process inside the jail.\n"
          "  -p, --allow-new-privs    Don't prevent setuid binaries from raising privileges.\n"
          "  --keep-shm               Keep the host's /dev/shm directory.\n"
          "  --keep-ipc-namespace     Stay in the host's IPC namespace. This is necessary for\n"
          "                           Xorg's MIT-SHM extension.\n"
          "  -H, --homedir <DIR>      Use DIR as home directory instead of a temporary one.\n"
+         "  --home-skeleton <DIR>    Copy the contents of DIR into the temporary home directory.\n"
+         "  --scratch-dir <DIR>      Keep /tmp, /var/tmp and the temporary home directory in a new\n"
+         "                           directory below DIR instead of in memory. The directory is\n"
+         "                           deleted in the background when the jail exits.\n"
          "  -K, --keep <DIR>         Do not unmount DIR inside the jail.\n"
          "                           This option also affects all mounts that are parents of DIR.\n"
          "  --keep-full <DIR>        Like --keep, but also affects all submounts of DIR.\n"
          "  -S, --shared <DIR>       Do not force private mount propagation on submounts of DIR.\n"
          "  -M, --mask <DIR>         Make DIR and all its subdirectories inaccessible in the jail.\n"
+         "  --mask-backend <BACKEND> Determine how --mask and --read-only are enforced.\n"
+         "                            mount:    Mount an empty tmpfs over each masked directory and\n"
+         "                                      remount everything read-only (default)\n"
+         "                            landlock: Restrict file system access with Landlock, without\n"
+         "                                      any mounts. The names of entries in masked directories\n"
+         "                                      stay visible in listings of their parents. Directories\n"
+         "                                      can only be masked with --read-only, and not below\n"
+         "                                      /dev, /proc, /run, /tmp or /var/tmp.\n"
+         "                                      Falls back to mount if Landlock is unavailable.\n"
+         "  --minimal-root           Build a new root file system that only contains the kept mounts,\n"
+         "                           instead of unmounting everything else from a copy of the host's.\n"
          "  --read-only              Make the file system read-only.\n"
+         "  --seccomp <PROFILE>      Install a seccomp filter that denies some system calls with EPERM.\n"
+         "                            none:    No filter (default)\n"
+         "                            default: Deny system calls that administer the host\n"
+         "                                     (mount, module loading, bpf, reboot, ...)\n"
+         "                            strict:  Also deny ptrace, io_uring, unshare, setns, ...\n"
          "  -X, --x11                Allow X11 access.\n"
          "  --x11-trusted            Generate a trusted X11 cookie (an untrusted cookie is used by default).\n"
          "  --x11-timeout <N>        If no X11 client is connected for N seconds, the cookie is revoked.\n"
          "  --x11-cookie <STRING>    Use a manually supplied X11 security cookie.\n"
          "  -N, --private-network    Isolate from the host network.\n"
          "  -n, --no-private-network Do not isolate from the host network.\n"
+         "  --ipvlan <DEV>           Give the private network an ipvlan interface " IPVLAN_INTERFACE " on the host's\n"
+         "                           network device DEV. Implies --private-network.\n"
+         "  --ipvlan-address <ADDR/PREFIX>\n"
+         "                           Assign ADDR/PREFIX to the ipvlan interface. ADDR must be in\n"
+         "                           a network permitted by the configuration.\n"
+         "  --ipvlan-gateway <ADDR>  Add a default route via ADDR on the ipvlan interface.\n"
+         "  --listen <ADDR:PORT>     Listen on the TCP port ADDR:PORT of the host's network and pass\n"
+         "                           the socket to the jail like systemd's socket activation\n"
+         "                           (LISTEN_FDS). ADDR may be empty, IPv6 addresses are given\n"
+         "                           in brackets. May be given multiple times.\n"
          "  -R, --run <MODE>         Determine how to handle the /run directory.\n"
          "                            host:    Keep the host's /run directory\n"
          "                            user:    Only keep /run/user/UID\n"
@@ -64,19 +133,45 @@ static void usage() {
          "  --keep-fd FD             Do not close the file descriptor FD.\n"
          "  --tmpfs-size SZ          Limit the size of the tmpfs instance used for the jail's temporary\n"
          "                           directory to SZ. The suffixes K, M or G are allowed.\n"
+         "  --shm-size SZ            Mount a private tmpfs of size SZ on /dev/shm.\n"
+         "                           This option has no effect with --keep-shm.\n"
+         "  --hugetlbfs <PAGESIZE:SZ>\n"
+         "                           Mount a private hugetlbfs with the huge page size PAGESIZE\n"
+         "                           on /dev/hugepages, limited to SZ. If the configuration does\n"
+         "                           not set MaxHugetlbfsSize, this option is not permitted.\n"
+         "  --cpus LIST              Run the jail on the CPUs in LIST, like 0-3,8,10-11.\n"
+         "  --numa-node N            Allocate the jail's memory, including its tmpfs, on NUMA node N.\n"
+         "  --thp <MODE>             Determine whether the jail uses transparent huge pages.\n"
+         "                            default: Use the system setting\n"
+         "                            never:   Disable transparent huge pages\n"
+         "                            madvise: Only for memory that requests them with madvise()\n"
+         "  --sched <POLICY>         Run the jail with the scheduling policy other, batch or idle.\n"
+         "  --nice N                 Run the jail with the nice value N.\n"
+         "  --ioprio <CLASS[:LEVEL]> Run the jail with an I/O priority. CLASS is be or idle,\n"
+         "                           LEVEL is 0 (highest) to 7.\n"
+         "  --timer-slack NS         Allow timers in the jail to expire up to NS nanoseconds late.\n"
+         "  --prefetch <MODE>        Read the files the command opens at startup into the page cache\n"
+         "                           while the jail is set up. The files are recorded per command\n"
+         "                           in ~/.config/appjail/prefetch.\n"
+         "                            off:    Do not prefetch (default)\n"
+         "                            record: Record the files the jail opens, if permitted\n"
+         "                                    by the configuration\n"
+         "                            replay: Prefetch the recorded files\n"
+         "                            auto:   Replay if the command was recorded, record otherwise\n"
+         "  --prefetch-window MS     Record the files opened in the first MS milliseconds (default: 2000).\n"
+         "                           The configuration may impose a smaller limit.\n"
          "  --setuid UID             Run jailed process under specified user ID,\n"
          "                           which must be between " TO_STR(MIN_SAFE_UID) " and " TO_STR(MAX_SAFE_UID) ".\n"
          "\n");
 }
 
-char *remove_trailing_slash(const char *p) {
-  char *r = strdup(p);
-  size_t len = strlen(r);
+static void append_path(strlist *l, const char *p) {
+  size_t len = strlen(p);
 
-  while(len > 0 && r[len-1] == '/') {
-    r[--len] = '\0';
-  }
-  return r;
+  /* remove trailing slashes */
+  while(len > 0 && p[len-1] == '/')
+    len--;
+  strlist_append_len(l, p, len);
 }
 
 #define OPT_KEEP_SHM 256
@@ -96,17 +191,54 @@ char *remove_trailing_slash(const char *p) {
 #define OPT_KEEP_OUTPUT 270
 #define OPT_X11_COOKIE 271
 #define OPT_SETUID 272
+#define OPT_LOG_OUTPUT 273
+#define OPT_LOG_MAX_SIZE 274
+#define OPT_LOG_KEEP 275
+#define OPT_MINIMAL_ROOT 276
+#define OPT_SECCOMP 277
+#define OPT_MASK_BACKEND 278
+#define OPT_PRESSURE 279
+#define OPT_PRESSURE_ACTION 280
+#define OPT_CPUS 281
+#define OPT_NUMA_NODE 282
+#define OPT_THP 283
+#define OPT_SCHED 284
+#define OPT_NICE 285
+#define OPT_IOPRIO 286
+#define OPT_TIMER_SLACK 287
+#define OPT_IPVLAN 288
+#define OPT_IPVLAN_ADDRESS 289
+#define OPT_IPVLAN_GATEWAY 290
+#define OPT_LISTEN 291
+#define OPT_SHM_SIZE 292
+#define OPT_HUGETLBFS 293
+#define OPT_PREFETCH 294
+#define OPT_PREFETCH_WINDOW 295
+#define OPT_HOME_SKELETON 296
+#define OPT_EVENT_LOG 297
+#define OPT_SETUP_STATS 298
+#define OPT_SETUP_TRACE 299
+#define OPT_CGROUP 301
+#define OPT_RECLAIM_IDLE 302
+#define OPT_SCRATCH_DIR 303
+#define OPT_NOTIFY_READY 304
+#define OPT_NOTIFY_TIMEOUT 305
 
 appjail_options *parse_options(int argc, char *argv[], const appjail_config *config) {
   int opt, i;
   unsigned long long int size;
+  unsigned int node;
+  cpu_set_t cpus, allowed;
   appjail_options *opts;
-  struct passwd *pw;
+  identity self;
+  struct stat st;
   static struct option long_options[] = {
     { "version",            no_argument,       0,  'V'                    },
     { "help",               no_argument,       0,  'h'                    },
     { "allow-new-privs",    no_argument,       0,  'p'                    },
     { "homedir",            required_argument, 0,  'H'                    },
+    { "home-skeleton",      required_argument, 0,  OPT_HOME_SKELETON      },
+    { "scratch-dir",        required_argument, 0,  OPT_SCRATCH_DIR        },
     { "keep-shm",           no_argument,       0,  OPT_KEEP_SHM           },
     { "keep-ipc-namespace", no_argument,       0,  OPT_KEEP_IPC_NAMESPACE },
     { "keep",               required_argument, 0,  'K'                    },
@@ -123,14 +255,44 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
     { "no-run-media",       no_argument,       0,  OPT_NO_RUN_MEDIA       },
     { "system-bus",         no_argument,       0,  OPT_KEEP_SYSTEM_BUS    },
     { "mask",               required_argument, 0,  'M'                    },
+    { "mask-backend",       required_argument, 0,  OPT_MASK_BACKEND       },
+    { "minimal-root",       no_argument,       0,  OPT_MINIMAL_ROOT       },
+    { "seccomp",            required_argument, 0,  OPT_SECCOMP            },
     { "daemonize",          no_argument,       0,  'd'                    },
     { "keep-output",        no_argument,       0,  OPT_KEEP_OUTPUT        },
+    { "log-output",         required_argument, 0,  OPT_LOG_OUTPUT         },
+    { "log-max-size",       required_argument, 0,  OPT_LOG_MAX_SIZE       },
+    { "log-keep",           required_argument, 0,  OPT_LOG_KEEP           },
+    { "notify-ready",       no_argument,       0,  OPT_NOTIFY_READY       },
+    { "notify-timeout",     required_argument, 0,  OPT_NOTIFY_TIMEOUT     },
+    { "event-log",          required_argument, 0,  OPT_EVENT_LOG          },
+    { "setup-stats",        no_argument,       0,  OPT_SETUP_STATS        },
+    { "setup-trace",        no_argument,       0,  OPT_SETUP_TRACE        },
+    { "pressure",           required_argument, 0,  OPT_PRESSURE           },
+    { "pressure-action",    required_argument, 0,  OPT_PRESSURE_ACTION    },
+    { "cgroup",             no_argument,       0,  OPT_CGROUP             },
+    { "reclaim-idle",       required_argument, 0,  OPT_RECLAIM_IDLE       },
     { "initstub",           no_argument,       0,  'i'                    },
     { "keep-fd",            required_argument, 0,  OPT_KEEP_FD            },
     { "no-clean-env",       no_argument,       0,  OPT_NO_CLEAN_ENV       },
     { "keep-env",           required_argument, 0,  OPT_KEEP_ENV           },
     { "set-env",            required_argument, 0,  OPT_SET_ENV            },
     { "read-only",          no_argument,       0,  OPT_READ_ONLY          },
+    { "shm-size",           required_argument, 0,  OPT_SHM_SIZE           },
+    { "hugetlbfs",          required_argument, 0,  OPT_HUGETLBFS          },
+    { "cpus",               required_argument, 0,  OPT_CPUS               },
+    { "numa-node",          required_argument, 0,  OPT_NUMA_NODE          },
+    { "thp",                required_argument, 0,  OPT_THP                },
+    { "ipvlan",             required_argument, 0,  OPT_IPVLAN             },
+    { "ipvlan-address",     required_argument, 0,  OPT_IPVLAN_ADDRESS     },
+    { "ipvlan-gateway",     required_argument, 0,  OPT_IPVLAN_GATEWAY     },
+    { "listen",             required_argument, 0,  OPT_LISTEN             },
+    { "prefetch",           required_argument, 0,  OPT_PREFETCH           },
+    { "prefetch-window",    required_argument, 0,  OPT_PREFETCH_WINDOW    },
+    { "sched",              required_argument, 0,  OPT_SCHED              },
+    { "nice",               required_argument, 0,  OPT_NICE               },
+    { "ioprio",             required_argument, 0,  OPT_IOPRIO             },
+    { "timer-slack",        required_argument, 0,  OPT_TIMER_SLACK        },
     { "setuid",             required_argument, 0,  OPT_SETUID             },
     { "tmpfs-size",         required_argument, 0,  OPT_TMPFS_SIZE         },
     { 0,                    0,                 0,  0                      }
@@ -142,35 +304,84 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
   /* special options */
   opts->uid = getuid();
   opts->switch_to_uid = 0;
-  errno = 0;
-  if((pw = getpwuid(opts->uid)) == NULL)
+  opts->switch_identity.name = NULL;
+  opts->switch_identity.groups = NULL;
+  if(!lookup_identity(opts->uid, &self))
     errExit("getpwuid");
-  opts->user = strdup(pw->pw_name);
+  opts->user = strdup(self.name);
+  free_identity(&self);
   /* defaults */
   opts->allow_new_privs = false;
   opts->keep_shm = false;
   opts->keep_ipc_namespace = false;
   opts->homedir = NULL;
+  opts->home_skeleton = NULL;
+  opts->scratch_dir = NULL;
+  opts->scratch = NULL;
   opts->keep_x11 = false;
   opts->x11_trusted = false;
   opts->x11_cookie = NULL;
   opts->x11_timeout = 60;
   opts->unshare_network = config->default_private_network;
+  opts->ipvlan_parent = NULL;
+  opts->ipvlan_address = NULL;
+  opts->ipvlan_gateway = NULL;
+  opts->netnsfd = -1;
+  opts->listen = strlist_new();
+  opts->listenfds = intlist_new();
   opts->run_mode = config->default_run_mode;
   opts->bind_run_media = config->default_bind_run_media;
   opts->keep_system_bus = false;
   opts->daemonize = false;
   opts->keep_output = false;
+  opts->log_output = NULL;
+  opts->event_log = NULL;
+  opts->events = NULL;
+  opts->setup_stats = false;
+  opts->setup_trace = false;
+  opts->log_max_size = 10 * 1024 * 1024;
+  opts->log_keep = 5;
+  opts->logfd = -1;
+  opts->notify_ready = false;
+  opts->notify_timeout = 90;
+  opts->notifyfd = -1;
+  opts->pressure = strlist_new();
+  opts->pressure_action = PRESSURE_LOG;
+  opts->own_cgroup = false;
+  opts->reclaim_idle = 0;
   opts->initstub = false;
   opts->cleanenv = true;
   opts->readonly = false;
+  opts->minimal_root = false;
+  opts->seccomp = SECCOMP_NONE;
+  /* the admin's limits are the defaults */
+  opts->has_cpus = config->has_allowed_cpus;
+  opts->cpus = config->allowed_cpus;
+  opts->has_numa_nodes = config->has_allowed_numa_nodes;
+  opts->numa_nodes = config->allowed_numa_nodes;
+  opts->thp = THP_DEFAULT;
+  opts->prefetch = PREFETCH_OFF;
+  opts->prefetch_window = 2000;
+  opts->prefetch_files = strlist_new();
+  opts->priority.policy = SCHED_POLICY_DEFAULT;
+  opts->priority.has_nice = false;
+  opts->priority.has_ioprio = false;
+  opts->priority.has_timer_slack = false;
+  opts->priority.has_min_nice = config->has_min_nice;
+  opts->priority.min_nice = config->min_nice;
+  opts->priority.has_min_ioprio = config->has_min_ioprio;
+  opts->priority.min_ioprio = config->min_ioprio;
   opts->has_tmpfs_size = config->has_max_tmpfs_size;
   opts->tmpfs_size = config->max_tmpfs_size;
+  opts->has_shm_size = config->has_max_shm_size;
+  opts->shm_size = config->max_shm_size;
+  opts->has_hugetlbfs = false;
   /* initialize directory lists */
   opts->keep_mounts = strlist_new();
   opts->keep_mounts_full = strlist_new();
   opts->shared_mounts = strlist_new();
   opts->mask_directories = strlist_new();
+  opts->mask_backend = MASK_MOUNT;
   opts->keepfds = intlist_new();
   opts->keepenv = strlist_new();
   opts->setenv = strlist_new();
@@ -213,6 +424,16 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
       case 'H':
         opts->homedir = optarg;
         break;
+      case OPT_HOME_SKELETON:
+        free(opts->home_skeleton);
+        if( (opts->home_skeleton = realpath(optarg, NULL)) == NULL )
+          errExit("Invalid argument to --home-skeleton");
+        break;
+      case OPT_SCRATCH_DIR:
+        free(opts->scratch_dir);
+        if( (opts->scratch_dir = realpath(optarg, NULL)) == NULL )
+          errExit("Invalid argument to --scratch-dir");
+        break;
       case OPT_KEEP_SHM:
         opts->keep_shm = true;
         break;
@@ -220,13 +441,13 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
         opts->keep_ipc_namespace = true;
         break;
       case 'K':
-        strlist_append(opts->keep_mounts, remove_trailing_slash(optarg));
+        append_path(opts->keep_mounts, optarg);
         break;
       case OPT_KEEP_FULL:
-        strlist_append(opts->keep_mounts_full, remove_trailing_slash(optarg));
+        append_path(opts->keep_mounts_full, optarg);
         break;
       case 'S':
-        strlist_append(opts->shared_mounts, remove_trailing_slash(optarg));
+        append_path(opts->shared_mounts, optarg);
         break;
       case 'X':
         opts->keep_x11 = true;
@@ -248,6 +469,31 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
       case 'n':
         opts->unshare_network = false;
         break;
+      case OPT_IPVLAN:
+        if(!strlist_contains(config->allowed_ipvlan_parents, optarg))
+          errExitNoErrno("--ipvlan device is not allowed by the configuration.");
+        free(opts->ipvlan_parent);
+        opts->ipvlan_parent = strdup(optarg);
+        break;
+      case OPT_IPVLAN_ADDRESS:
+        if(!is_valid_address(optarg))
+          errExitNoErrno("Invalid argument to --ipvlan-address.");
+        if(!is_allowed_address(optarg, config->allowed_ipvlan_addresses))
+          errExitNoErrno("--ipvlan-address is not allowed by the configuration.");
+        free(opts->ipvlan_address);
+        opts->ipvlan_address = strdup(optarg);
+        break;
+      case OPT_IPVLAN_GATEWAY:
+        if(!is_valid_address(optarg))
+          errExitNoErrno("Invalid argument to --ipvlan-gateway.");
+        free(opts->ipvlan_gateway);
+        opts->ipvlan_gateway = strdup(optarg);
+        break;
+      case OPT_LISTEN:
+        if(!is_valid_listen_address(optarg))
+          errExitNoErrno("Invalid argument to --listen.");
+        strlist_append_copy(opts->listen, optarg);
+        break;
       case 'R':
         if(!string_to_run_mode(&(opts->run_mode), optarg))
           errExitNoErrno("Invalid argument to -R/--run.");
@@ -262,7 +508,18 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
         opts->keep_system_bus = true;
         break;
       case 'M':
-        strlist_append(opts->mask_directories, remove_trailing_slash(optarg));
+        append_path(opts->mask_directories, optarg);
+        break;
+      case OPT_MASK_BACKEND:
+        if(!string_to_mask_backend(&(opts->mask_backend), optarg))
+          errExitNoErrno("Invalid argument to --mask-backend.");
+        break;
+      case OPT_MINIMAL_ROOT:
+        opts->minimal_root = true;
+        break;
+      case OPT_SECCOMP:
+        if(!string_to_seccomp_profile(&(opts->seccomp), optarg))
+          errExitNoErrno("Invalid argument to --seccomp.");
         break;
       case 'd':
         opts->daemonize = true;
@@ -270,6 +527,52 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
       case OPT_KEEP_OUTPUT:
         opts->keep_output = true;
         break;
+      case OPT_LOG_OUTPUT:
+        free(opts->log_output);
+        opts->log_output = strdup(optarg);
+        break;
+      case OPT_EVENT_LOG:
+        free(opts->event_log);
+        opts->event_log = strdup(optarg);
+        break;
+      case OPT_SETUP_STATS:
+        opts->setup_stats = true;
+        break;
+      case OPT_SETUP_TRACE:
+        opts->setup_stats = true;
+        opts->setup_trace = true;
+        break;
+      case OPT_LOG_MAX_SIZE:
+        if(!string_to_size(&(opts->log_max_size), optarg))
+          errExitNoErrno("Invalid argument to --log-max-size.");
+        break;
+      case OPT_LOG_KEEP:
+        if(!string_to_unsigned_integer(&(opts->log_keep), optarg))
+          errExitNoErrno("Invalid argument to --log-keep.");
+        break;
+      case OPT_NOTIFY_READY:
+        opts->notify_ready = true;
+        break;
+      case OPT_NOTIFY_TIMEOUT:
+        if(!string_to_unsigned_integer(&(opts->notify_timeout), optarg))
+          errExitNoErrno("Invalid argument to --notify-timeout.");
+        break;
+      case OPT_PRESSURE:
+        if(!is_valid_pressure_spec(optarg))
+          errExitNoErrno("Invalid argument to --pressure.");
+        strlist_append_copy(opts->pressure, optarg);
+        break;
+      case OPT_PRESSURE_ACTION:
+        if(!string_to_pressure_action(&(opts->pressure_action), optarg))
+          errExitNoErrno("Invalid argument to --pressure-action.");
+        break;
+      case OPT_CGROUP:
+        opts->own_cgroup = true;
+        break;
+      case OPT_RECLAIM_IDLE:
+        if(!string_to_unsigned_integer(&(opts->reclaim_idle), optarg) || opts->reclaim_idle == 0)
+          errExitNoErrno("Invalid argument to --reclaim-idle.");
+        break;
       case 'i':
         opts->initstub = true;
         break;
@@ -296,6 +599,70 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
 
         if (opts->switch_to_uid < MIN_SAFE_UID || opts->switch_to_uid > MAX_SAFE_UID)
           errExitNoErrno("--setuid argument is outside the allowed range.");
+
+        free_identity(&(opts->switch_identity));
+        if(!lookup_identity(opts->switch_to_uid, &(opts->switch_identity)))
+          errExitNoErrno("--setuid argument is not a known user.");
+        break;
+      case OPT_CPUS:
+        if(!string_to_cpu_list(&cpus, optarg))
+          errExitNoErrno("Invalid argument to --cpus.");
+        if(config->has_allowed_cpus) {
+          CPU_AND(&allowed, &cpus, &(config->allowed_cpus));
+          if(!CPU_EQUAL(&allowed, &cpus))
+            errExitNoErrno("--cpus contains CPUs that are not allowed by the configuration.");
+        }
+        opts->has_cpus = true;
+        opts->cpus = cpus;
+        break;
+      case OPT_NUMA_NODE:
+        if(!string_to_unsigned_integer(&node, optarg) || node >= CPU_SETSIZE)
+          errExitNoErrno("Invalid argument to --numa-node.");
+        if(config->has_allowed_numa_nodes && !CPU_ISSET(node, &(config->allowed_numa_nodes)))
+          errExitNoErrno("--numa-node is not allowed by the configuration.");
+        opts->has_numa_nodes = true;
+        CPU_ZERO(&(opts->numa_nodes));
+        CPU_SET(node, &(opts->numa_nodes));
+        break;
+      case OPT_THP:
+        if(!string_to_thp_mode(&(opts->thp), optarg))
+          errExitNoErrno("Invalid argument to --thp.");
+        break;
+      case OPT_PREFETCH:
+        if(!string_to_prefetch_mode(&(opts->prefetch), optarg))
+          errExitNoErrno("Invalid argument to --prefetch.");
+        break;
+      case OPT_PREFETCH_WINDOW:
+        if(!string_to_unsigned_integer(&(opts->prefetch_window), optarg)
+           || opts->prefetch_window == 0 || opts->prefetch_window > 60000)
+          errExitNoErrno("Invalid argument to --prefetch-window.");
+        break;
+      case OPT_SCHED:
+        if(!string_to_sched_policy(&(opts->priority.policy), optarg))
+          errExitNoErrno("Invalid argument to --sched.");
+        break;
+      case OPT_NICE:
+        if(!string_to_integer(&(opts->priority.nice), optarg)
+           || opts->priority.nice < -20 || opts->priority.nice > 19)
+          errExitNoErrno("Invalid argument to --nice.");
+        if(config->has_min_nice && opts->priority.nice < config->min_nice)
+          errExitNoErrno("--nice is below the minimum allowed by the configuration.");
+        opts->priority.has_nice = true;
+        break;
+      case OPT_IOPRIO:
+        if(!string_to_ioprio(&(opts->priority.ioprio), optarg))
+          errExitNoErrno("Invalid argument to --ioprio.");
+        if(ioprio_is_realtime(opts->priority.ioprio))
+          errExitNoErrno("The realtime I/O class is not available in a jail.");
+        if(config->has_min_ioprio && ioprio_rank(opts->priority.ioprio) < ioprio_rank(config->min_ioprio))
+          errExitNoErrno("--ioprio is higher than the maximum allowed by the configuration.");
+        opts->priority.has_ioprio = true;
+        break;
+      case OPT_TIMER_SLACK:
+        if(!string_to_size(&size, optarg) || size == 0)
+          errExitNoErrno("Invalid argument to --timer-slack.");
+        opts->priority.has_timer_slack = true;
+        opts->priority.timer_slack = size;
         break;
       case OPT_TMPFS_SIZE:
         if(!string_to_size(&size, optarg))
@@ -305,6 +672,25 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
           opts->tmpfs_size = size;
         }
         break;
+      case OPT_SHM_SIZE:
+        if(!string_to_size(&size, optarg) || size == 0)
+          errExitNoErrno("Invalid argument to --shm-size.");
+        if(!opts->has_shm_size || size < opts->shm_size) {
+          opts->has_shm_size = true;
+          opts->shm_size = size;
+        }
+        break;
+      case OPT_HUGETLBFS:
+        if(!config->has_max_hugetlbfs_size)
+          errExitNoErrno("--hugetlbfs is not permitted by the configuration.");
+        if(!string_to_hugetlbfs(&(opts->hugetlbfs_page_size), &(opts->hugetlbfs_size), optarg))
+          errExitNoErrno("Invalid argument to --hugetlbfs.");
+        if(opts->hugetlbfs_size > config->max_hugetlbfs_size)
+          opts->hugetlbfs_size = config->max_hugetlbfs_size;
+        if(opts->hugetlbfs_size < opts->hugetlbfs_page_size)
+          errExitNoErrno("--hugetlbfs is limited to less than one huge page.");
+        opts->has_hugetlbfs = true;
+        break;
       case ':':
         fprintf(stderr, "Option -%c requires an argument.\n", optopt);
         exit(EXIT_FAILURE);
@@ -321,6 +707,30 @@ appjail_options *parse_options(int argc, char *argv[], const appjail_config *con
   }
   opts->argv = &(argv[optind]);
 
+  if(opts->log_output != NULL && !opts->daemonize)
+    errExitNoErrno("--log-output requires --daemonize.");
+  /* Recording marks whole filesystems of the host with fanotify */
+  if(opts->prefetch == PREFETCH_RECORD || opts->prefetch == PREFETCH_AUTO) {
+    if(!config->has_max_prefetch_window)
+      errExitNoErrno("--prefetch record and auto are not permitted by the configuration.");
+    if(opts->prefetch_window > (unsigned int)config->max_prefetch_window)
+      opts->prefetch_window = config->max_prefetch_window;
+  }
+  if(opts->mask_backend == MASK_LANDLOCK && !landlock_can_mask(opts))
+    errExitNoErrno("--mask-backend landlock can only mask directories that are read-only in the jail, use --read-only or the mount backend.");
+  if(opts->home_skeleton != NULL && opts->homedir != NULL)
+    errExitNoErrno("--home-skeleton cannot be used with --homedir.");
+  for(i = LISTEN_FDS_START; i < LISTEN_FDS_START + (int)strlist_count(opts->listen); ++i)
+    if(intlist_contains(opts->keepfds, i))
+      errExitNoErrno("--keep-fd conflicts with the file descriptors passed by --listen.");
+  /* The jail shares the host's /dev, we cannot create the mount point */
+  if(opts->has_hugetlbfs && (stat("/dev/hugepages", &st) == -1 || !S_ISDIR(st.st_mode)))
+    errExitNoErrno("--hugetlbfs requires the directory /dev/hugepages on the host.");
+  if(opts->ipvlan_parent != NULL)
+    opts->unshare_network = true;
+  else if(opts->ipvlan_address != NULL || opts->ipvlan_gateway != NULL)
+    errExitNoErrno("--ipvlan-address and --ipvlan-gateway require --ipvlan.");
+
   opts->special_mounts = strlist_new();
   strlist_append_copy(opts->special_mounts, "/dev");
   strlist_append_copy(opts->special_mounts, "/proc");
@@ -339,8 +749,20 @@ void free_options(appjail_options *opts) {
   intlist_free(opts->keepfds);
   strlist_free(opts->keepenv);
   strlist_free(opts->setenv);
+  strlist_free(opts->pressure);
+  strlist_free(opts->listen);
+  intlist_free(opts->listenfds);
+  strlist_free(opts->prefetch_files);
   free(opts->user);
+  free_identity(&(opts->switch_identity));
   free(opts->x11_cookie);
+  free(opts->log_output);
+  free(opts->event_log);
+  free(opts->home_skeleton);
+  free(opts->scratch_dir);
+  free(opts->ipvlan_parent);
+  free(opts->ipvlan_address);
+  free(opts->ipvlan_gateway);
   free(opts);
 }
 
@@ -359,6 +781,36 @@ bool string_to_run_mode(run_mode_t *result, const char *s) {
   return ret;
 }
 
+bool string_to_mask_backend(mask_backend_t *result, const char *s) {
+  bool ret = true;
+
+  if(!strcmp(s, "mount"))
+    *result = MASK_MOUNT;
+  else if(!strcmp(s, "landlock"))
+    *result = MASK_LANDLOCK;
+  else
+    ret = false;
+
+  return ret;
+}
+
+/* PAGESIZE:SZ, PAGESIZE must be a huge page size supported by the kernel */
+bool string_to_hugetlbfs(unsigned long long int *page_size, unsigned long long int *size, const char *s) {
+  char buf[32], path[PATH_MAX];
+  const char *colon;
+  struct stat st;
+
+  if( (colon = strchr(s, ':')) == NULL || (size_t)(colon - s) >= sizeof(buf) )
+    return false;
+  memcpy(buf, s, colon - s);
+  buf[colon - s] = '\0';
+  if(!string_to_size(page_size, buf) || !string_to_size(size, colon + 1))
+    return false;
+
+  snprintf(path, PATH_MAX, "/sys/kernel/mm/hugepages/hugepages-%llukB", *page_size / 1024);
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
 bool string_to_size(unsigned long long int *size, const char *s) {
   unsigned long long int res;
   char *end;
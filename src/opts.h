@@ -2,11 +2,20 @@
 
 #include "common.h"
 #include "configfile.h"
+#include "eventlog.h"
+#include "identity.h"
 #include "list.h"
+#include "placement.h"
+#include "prefetch.h"
+#include "pressure.h"
+#include "priority.h"
+#include "seccomp.h"
 
 typedef struct {
   uid_t uid;
   uid_t switch_to_uid;
+  /* resolved before the jail is set up, the child must not use NSS */
+  identity switch_identity;
 
   char *user;
 
@@ -16,6 +25,8 @@ typedef struct {
   bool keep_shm;
   bool keep_ipc_namespace;
   const char *homedir;
+  char *home_skeleton;
+  char *scratch_dir;
   run_mode_t run_mode;
   bool bind_run_media;
   bool keep_system_bus;
@@ -26,30 +37,71 @@ typedef struct {
   strlist *shared_mounts;
   strlist *special_mounts;
   strlist *mask_directories;
+  mask_backend_t mask_backend;
+  bool minimal_root;
   bool keep_x11;
   bool x11_trusted;
   unsigned int x11_timeout;
   bool unshare_network;
+  char *ipvlan_parent;
+  char *ipvlan_address;
+  char *ipvlan_gateway;
+  strlist *listen;
 
   bool daemonize;
   bool keep_output;
+  char *log_output;
+  unsigned long long int log_max_size;
+  unsigned int log_keep;
+  bool notify_ready;
+  unsigned int notify_timeout;
+  char *event_log;
+  strlist *pressure;
+  pressure_action_t pressure_action;
+  bool own_cgroup;
+  unsigned int reclaim_idle;
   bool initstub;
   intlist *keepfds;
   strlist *keepenv;
   strlist *setenv;
   bool cleanenv;
   bool readonly;
+  seccomp_profile_t seccomp;
 
+  bool has_cpus;
+  cpu_set_t cpus;
+  bool has_numa_nodes;
+  cpu_set_t numa_nodes;
+  thp_mode_t thp;
+  priority_options priority;
+  bool setup_stats;
+  bool setup_trace;
+  prefetch_mode_t prefetch;
+  unsigned int prefetch_window;
   bool has_tmpfs_size;
   unsigned long long int tmpfs_size;
+  bool has_shm_size;
+  unsigned long long int shm_size;
+  bool has_hugetlbfs;
+  unsigned long long int hugetlbfs_page_size;
+  unsigned long long int hugetlbfs_size;
 
   /* Internal options */
   bool setup_tty;
   int pipefd;
+  int logfd;
+  int notifyfd;
+  int netnsfd;
+  intlist *listenfds;
+  strlist *prefetch_files;
+  event_log *events;
+  char *scratch;
 } appjail_options;
 
 appjail_options *parse_options(int argc, char *argv[], const appjail_config *config);
 void free_options(appjail_options *opts);
 
 bool string_to_run_mode(run_mode_t *result, const char *s);
+bool string_to_mask_backend(mask_backend_t *result, const char *s);
 bool string_to_size(unsigned long long int *size, const char *s);
+bool string_to_hugetlbfs(unsigned long long int *page_size, unsigned long long int *size, const char *s);
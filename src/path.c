@@ -3,15 +3,18 @@
 #include "mounts.h"
 #include "cap.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/mount.h>
 
 void setup_path(const char *name, const char *path, mode_t mode) {
   char p[PATH_MAX];
 
   snprintf(p, PATH_MAX-1, "./%s", name);
-  if( mkdir(p, mode) == -1 )
+  /* a setup task may have created it already */
+  if( mkdir(p, mode) == -1 && errno != EEXIST )
     errExit("mkdir");
   if( chmod(p, mode) == -1 )
     errExit("chmod");
@@ -21,3 +24,39 @@ void setup_path(const char *name, const char *path, mode_t mode) {
   if( cap_mount(NULL, path, NULL, MS_PRIVATE, NULL) == -1 )
     errExit("mount --make-private");
 }
+
+/* Mount a new instance of fstype over path, instead of a directory on
+ * the jail's tmpfs, so it gets its own size limit */
+void setup_private_fs(const char *fstype, const char *path, const char *data) {
+  unmount_directory(path);
+  if( cap_mount(fstype, path, fstype, MS_NODEV | MS_NOSUID, data) == -1 ) {
+    fprintf(stderr, "Unable to mount %s on %s: %s\n", fstype, path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if( cap_mount(NULL, path, NULL, MS_PRIVATE, NULL) == -1 )
+    errExit("mount --make-private");
+}
+
+/* Back ./name with a directory of the jail's scratch directory on the
+ * host's disk. This has to happen before the host's mounts are
+ * unmounted, setup_path() later binds it to its final place.
+ */
+void bind_scratch_path(const char *scratch, const char *dir, const char *name) {
+  char src[PATH_MAX], p[PATH_MAX];
+
+  snprintf(src, PATH_MAX-1, "%s/%s", scratch, dir);
+  snprintf(p, PATH_MAX-1, "./%s", name);
+  if( mkdir(p, 0755) == -1 && errno != EEXIST )
+    errExit("mkdir");
+  if( cap_mount(src, p, NULL, MS_BIND, NULL) == -1 )
+    errExit("mount --bind");
+}
+
+/* The scratch directory only stays mounted at the final place */
+void unbind_scratch_path(const char *name) {
+  char p[PATH_MAX];
+
+  snprintf(p, PATH_MAX-1, "./%s", name);
+  if( cap_umount2(p, 0) == -1 )
+    errExit("umount");
+}
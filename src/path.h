@@ -3,3 +3,6 @@
 #include <sys/stat.h>
 
 void setup_path(const char *name, const char *path, mode_t mode);
+void setup_private_fs(const char *fstype, const char *path, const char *data);
+void bind_scratch_path(const char *scratch, const char *dir, const char *name);
+void unbind_scratch_path(const char *name);
@@ -0,0 +1,117 @@
+#include "placement.h"
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+#ifndef PR_THP_DISABLE_EXCEPT_ADVISED
+#define PR_THP_DISABLE_EXCEPT_ADVISED (1 << 1)
+#endif
+
+/* NUMA node masks are limited to the size of an unsigned long */
+#define MAX_NUMA_NODES (sizeof(unsigned long) * CHAR_BIT)
+
+static bool parse_cpu_number(const char **s, unsigned long *n) {
+  char *end;
+
+  if(**s < '0' || **s > '9')
+    return false;
+  errno = 0;
+  *n = strtoul(*s, &end, 10);
+  if(errno != 0 || *n >= CPU_SETSIZE)
+    return false;
+  *s = end;
+  return true;
+}
+
+bool string_to_cpu_list(cpu_set_t *set, const char *s) {
+  unsigned long first, last, i;
+
+  CPU_ZERO(set);
+  do {
+    if(!parse_cpu_number(&s, &first))
+      return false;
+    last = first;
+    if(*s == '-') {
+      s++;
+      if(!parse_cpu_number(&s, &last) || last < first)
+        return false;
+    }
+    for(i = first; i <= last; ++i)
+      CPU_SET(i, set);
+  } while(*s++ == ',');
+
+  return *(s-1) == '\0';
+}
+
+bool string_to_thp_mode(thp_mode_t *result, const char *s) {
+  bool ret = true;
+
+  if(!strcmp(s, "default"))
+    *result = THP_DEFAULT;
+  else if(!strcmp(s, "never"))
+    *result = THP_NEVER;
+  else if(!strcmp(s, "madvise"))
+    *result = THP_MADVISE;
+  else
+    ret = false;
+
+  return ret;
+}
+
+/* Node list for the tmpfs mpol= option, like 0,1 */
+void format_node_list(char *buf, size_t len, const cpu_set_t *nodes) {
+  size_t i, pos = 0;
+
+  buf[0] = '\0';
+  for(i = 0; i < MAX_NUMA_NODES && pos < len; ++i)
+    if(CPU_ISSET(i, nodes))
+      pos += snprintf(buf + pos, len - pos, pos == 0 ? "%zu" : ",%zu", i);
+}
+
+static void bind_memory(const cpu_set_t *nodes) {
+  unsigned long mask = 0;
+  size_t i;
+
+  for(i = 0; i < CPU_SETSIZE; ++i)
+    if(CPU_ISSET(i, nodes)) {
+      if(i >= MAX_NUMA_NODES)
+        errExitNoErrno("NUMA node number is too large.");
+      mask |= 1UL << i;
+    }
+  /* the kernel ignores the last bit of maxnode */
+  if( syscall(SYS_set_mempolicy, MPOL_BIND, &mask, MAX_NUMA_NODES + 1) == -1 )
+    errExit("set_mempolicy");
+}
+
+/* CPU affinity, the memory policy and the THP setting are inherited by
+ * children and kept across execve(), so they also apply to everything
+ * that is started from the initstub.
+ */
+void apply_placement(bool has_cpus, const cpu_set_t *cpus, bool has_numa_nodes, const cpu_set_t *numa_nodes, thp_mode_t thp) {
+  if( has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), cpus) == -1 )
+    errExit("sched_setaffinity");
+
+  if( has_numa_nodes )
+    bind_memory(numa_nodes);
+
+  switch(thp) {
+    case THP_NEVER:
+      if( prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0) == -1 )
+        errExit("prctl(PR_SET_THP_DISABLE)");
+      break;
+    case THP_MADVISE:
+      /* only for regions that asked for huge pages with madvise() */
+      if( prctl(PR_SET_THP_DISABLE, 1, PR_THP_DISABLE_EXCEPT_ADVISED, 0, 0) == -1 )
+        errExit("prctl(PR_SET_THP_DISABLE)");
+      break;
+    default:
+      break;
+  }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "common.h"
+#include <sched.h>
+
+typedef enum { THP_DEFAULT, THP_NEVER, THP_MADVISE } thp_mode_t;
+
+/* Parses lists like 0-3,8,10-11 */
+bool string_to_cpu_list(cpu_set_t *set, const char *s);
+bool string_to_thp_mode(thp_mode_t *result, const char *s);
+void format_node_list(char *buf, size_t len, const cpu_set_t *nodes);
+
+void apply_placement(bool has_cpus, const cpu_set_t *cpus, bool has_numa_nodes, const cpu_set_t *numa_nodes, thp_mode_t thp);
@@ -0,0 +1,255 @@
+#include "prefetch.h"
+#include "cap.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/fanotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifndef FAN_MARK_FILESYSTEM
+#define FAN_MARK_FILESYSTEM 0x00000100
+#endif
+#ifndef FAN_OPEN_EXEC
+#define FAN_OPEN_EXEC 0x00001000
+#endif
+
+/* Profiles are capped, the first files are the ones that matter */
+#define PREFETCH_MAX_FILES 4096
+
+/* File systems that hold the programs and libraries */
+static const char *recorded_paths[] = { "/", "/usr", "/opt", NULL };
+
+bool string_to_prefetch_mode(prefetch_mode_t *result, const char *s) {
+  bool ret = true;
+
+  if(!strcmp(s, "off"))
+    *result = PREFETCH_OFF;
+  else if(!strcmp(s, "record"))
+    *result = PREFETCH_RECORD;
+  else if(!strcmp(s, "replay"))
+    *result = PREFETCH_REPLAY;
+  else if(!strcmp(s, "auto"))
+    *result = PREFETCH_AUTO;
+  else
+    ret = false;
+
+  return ret;
+}
+
+static bool profile_directory(char *dir, size_t len) {
+  const char *base;
+
+  if( (base = getenv("XDG_CONFIG_HOME")) != NULL && base[0] == '/' )
+    snprintf(dir, len, "%s/appjail/prefetch", base);
+  else if( (base = getenv("HOME")) != NULL )
+    snprintf(dir, len, "%s/.config/appjail/prefetch", base);
+  else
+    return false;
+  return true;
+}
+
+/* One profile per command, named after the command and a hash of
+ * how it was given */
+char *prefetch_profile_path(const char *command) {
+  char dir[PATH_MAX], *path;
+  const char *name;
+  uint64_t hash = 14695981039346656037ULL;
+  const char *c;
+
+  if(!profile_directory(dir, sizeof(dir)))
+    return NULL;
+  /* FNV-1a */
+  for(c = command; *c != '\0'; ++c) {
+    hash ^= (unsigned char)*c;
+    hash *= 1099511628211ULL;
+  }
+  name = strrchr(command, '/');
+  name = name != NULL ? name + 1 : command;
+  if( asprintf(&path, "%s/%s-%016llx", dir, name, (unsigned long long int)hash) == -1 )
+    errExit("asprintf");
+  return path;
+}
+
+bool prefetch_load(strlist *files, const char *profile) {
+  FILE *f;
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t len;
+
+  if( (f = fopen(profile, "re")) == NULL )
+    return false;
+  while( (len = getline(&line, &size, f)) > 0 ) {
+    if(line[len-1] == '\n')
+      len--;
+    if(len > 0 && line[0] == '/')
+      strlist_append_len(files, line, len);
+  }
+  free(line);
+  fclose(f);
+  return strlist_first(files) != NULL;
+}
+
+/* Watch every open on the file systems the jail's programs come from.
+ * This must happen before the jail is cloned, it needs CAP_SYS_ADMIN.
+ */
+int prefetch_record_start() {
+  int fd, i;
+
+  need_cap(CAP_SYS_ADMIN);
+  fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+  if(fd == -1)
+    errWarn("fanotify_init");
+  for(i = 0; fd != -1 && recorded_paths[i] != NULL; ++i)
+    if( fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FAN_OPEN | FAN_OPEN_EXEC, AT_FDCWD, recorded_paths[i]) == -1
+        && errno != ENOENT ) {
+      errWarn("fanotify_mark");
+      close(fd);
+      fd = -1;
+    }
+  drop_caps();
+  return fd;
+}
+
+static ino_t pid_namespace(pid_t pid) {
+  char path[64];
+  struct stat st;
+
+  snprintf(path, sizeof(path), "/proc/%d/ns/pid", (int)pid);
+  return stat(path, &st) == 0 ? st.st_ino : 0;
+}
+
+static long long int now_ms() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long int)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void record_event(const struct fanotify_event_metadata *m, ino_t jailns, strlist *files) {
+  static pid_t last_pid = 0;
+  static bool last_in_jail = false;
+  char link[64], path[PATH_MAX];
+  struct stat st;
+  ssize_t len;
+
+  /* Everything in the jail's PID namespace belongs to the jail */
+  if(m->pid != last_pid) {
+    last_pid = m->pid;
+    last_in_jail = pid_namespace(m->pid) == jailns;
+  }
+  if(!last_in_jail || strlist_count(files) >= PREFETCH_MAX_FILES)
+    return;
+  if( fstat(m->fd, &st) == -1 || !S_ISREG(st.st_mode) )
+    return;
+
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", m->fd);
+  if( (len = readlink(link, path, sizeof(path) - 1)) <= 0 || path[0] != '/' )
+    return;
+  path[len] = '\0';
+  if(!strlist_contains(files, path))
+    strlist_append_copy(files, path);
+}
+
+static void write_profile(const char *profile, strlist *files) {
+  char dir[PATH_MAX], tmp[PATH_MAX], *p;
+  strlist_node *n;
+  FILE *f;
+
+  /* create the profile directory and its parents */
+  snprintf(dir, sizeof(dir), "%s", profile);
+  for(p = dir + 1; (p = strchr(p, '/')) != NULL; ++p) {
+    *p = '\0';
+    if( mkdir(dir, 0700) == -1 && errno != EEXIST )
+      return;
+    *p = '/';
+  }
+
+  snprintf(tmp, sizeof(tmp), "%s.%d", profile, (int)getpid());
+  if( (f = fopen(tmp, "we")) == NULL )
+    return;
+  for(n = strlist_first(files); n != NULL; n = strlist_next(n))
+    fprintf(f, "%s\n", strlist_val(n));
+  if( fclose(f) != 0 || rename(tmp, profile) == -1 )
+    unlink(tmp);
+}
+
+static void record(int fanfd, pid_t pid1, const char *profile, unsigned int window) {
+  char buf[8192] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+  const struct fanotify_event_metadata *m;
+  struct pollfd pfd;
+  long long int deadline, left;
+  strlist *files;
+  ino_t jailns;
+  ssize_t len;
+
+  if( (jailns = pid_namespace(pid1)) == 0 )
+    return;
+  files = strlist_new();
+  pfd.fd = fanfd;
+  pfd.events = POLLIN;
+  deadline = now_ms() + window;
+  while( (left = deadline - now_ms()) > 0 ) {
+    if( poll(&pfd, 1, left) <= 0 )
+      continue;
+    if( (len = read(fanfd, buf, sizeof(buf))) <= 0 )
+      continue;
+    for(m = (const struct fanotify_event_metadata*)buf; FAN_EVENT_OK(m, len); m = FAN_EVENT_NEXT(m, len)) {
+      if(m->vers != FANOTIFY_METADATA_VERSION)
+        goto out;
+      if(m->fd >= 0) {
+        record_event(m, jailns, files);
+        close(m->fd);
+      }
+    }
+  }
+  write_profile(profile, files);
+out:
+  strlist_free(files);
+}
+
+/* Record the files the jail opens during its first window milliseconds
+ * in a process of its own, so the supervisor is not held up. The
+ * recorder is not our child, the supervisor only ever reaps the jail.
+ */
+void prefetch_record(int fanfd, pid_t pid1, const char *profile, unsigned int window) {
+  pid_t pid;
+
+  switch( (pid = fork()) ) {
+    case -1:
+      errWarn("fork");
+      return;
+    case 0:
+      if(fork() == 0) {
+        record(fanfd, pid1, profile, window);
+        _exit(EXIT_SUCCESS);
+      }
+      _exit(EXIT_SUCCESS);
+    default:
+      waitpid(pid, NULL, 0);
+  }
+}
+
+/* Setup task: start reading the recorded files into the page cache
+ * while the mounts are set up. Missing files are simply skipped.
+ */
+int prefetch_task(void *arg) {
+  strlist *files = (strlist*)arg;
+  strlist_node *n;
+  struct stat st;
+  int fd;
+
+  for(n = strlist_first(files); n != NULL; n = strlist_next(n))
+    if( stat(strlist_val(n), &st) == 0 && S_ISREG(st.st_mode)
+        && (fd = open(strlist_val(n), O_RDONLY | O_CLOEXEC | O_NONBLOCK)) != -1 ) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      close(fd);
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+#include "list.h"
+
+typedef enum {
+  PREFETCH_OFF,
+  PREFETCH_RECORD,
+  PREFETCH_REPLAY,
+  PREFETCH_AUTO
+} prefetch_mode_t;
+
+bool string_to_prefetch_mode(prefetch_mode_t *result, const char *s);
+char *prefetch_profile_path(const char *command);
+bool prefetch_load(strlist *files, const char *profile);
+int prefetch_record_start();
+void prefetch_record(int fanfd, pid_t pid1, const char *profile, unsigned int window);
+int prefetch_task(void *arg);
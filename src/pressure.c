@@ -0,0 +1,91 @@
+#include "pressure.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The kernel's limits for the trigger window */
+#define MIN_WINDOW_MS 500
+#define MAX_WINDOW_MS 10000
+
+/* RESOURCE:STALL_MS:WINDOW_MS, like memory:150:1000 */
+static bool parse_pressure_spec(const char *s, char *resource, unsigned int *stall, unsigned int *window) {
+  char extra;
+
+  if( sscanf(s, "%15[a-z]:%u:%u%c", resource, stall, window, &extra) != 3 )
+    return false;
+  if( strcmp(resource, "cpu") && strcmp(resource, "memory") && strcmp(resource, "io") )
+    return false;
+  return *window >= MIN_WINDOW_MS && *window <= MAX_WINDOW_MS
+         && *stall > 0 && *stall <= *window;
+}
+
+bool is_valid_pressure_spec(const char *s) {
+  char resource[16];
+  unsigned int stall, window;
+
+  return parse_pressure_spec(s, resource, &stall, &window);
+}
+
+bool string_to_pressure_action(pressure_action_t *result, const char *s) {
+  bool ret = true;
+
+  if(!strcmp(s, "log"))
+    *result = PRESSURE_LOG;
+  else if(!strcmp(s, "term"))
+    *result = PRESSURE_TERM;
+  else if(!strcmp(s, "kill"))
+    *result = PRESSURE_KILL;
+  else
+    ret = false;
+
+  return ret;
+}
+
+/* Register a PSI trigger in the jail's cgroup for every specification.
+ * A trigger fires when the jail's tasks were stalled for more than
+ * STALL_MS within any WINDOW_MS.
+ */
+pressure_monitor *pressure_open(const char *cgroup, strlist *specs, pressure_action_t action) {
+  char resource[16], path[PATH_MAX], trigger[64];
+  unsigned int stall, window;
+  pressure_monitor *m;
+  strlist_node *i;
+  int fd, len;
+
+  if( (m = malloc(sizeof(pressure_monitor))) == NULL )
+    errExit("malloc");
+  m->ntriggers = 0;
+  m->action = action;
+
+  for(i = strlist_first(specs); i != NULL; i = strlist_next(i)) {
+    if(m->ntriggers == MAX_PRESSURE_TRIGGERS)
+      errExitNoErrno("Too many --pressure triggers.");
+    if(!parse_pressure_spec(strlist_val(i), resource, &stall, &window))
+      errExitNoErrno("Internal error: invalid pressure trigger.");
+
+    snprintf(path, PATH_MAX, "%s/%s.pressure", cgroup, resource);
+    if( (fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) == -1 )
+      errExit("open pressure file");
+    len = snprintf(trigger, sizeof(trigger), "some %u %u", stall * 1000, window * 1000);
+    /* the terminating NUL is part of the trigger */
+    if( write(fd, trigger, len + 1) == -1 )
+      errExit("write pressure trigger");
+
+    m->fds[m->ntriggers] = fd;
+    m->specs[m->ntriggers] = strdup(strlist_val(i));
+    m->ntriggers++;
+  }
+
+  return m;
+}
+
+void pressure_close(pressure_monitor *m) {
+  int i;
+
+  for(i = 0; i < m->ntriggers; ++i) {
+    close(m->fds[i]);
+    free(m->specs[i]);
+  }
+  free(m);
+}
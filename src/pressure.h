@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+#include "list.h"
+
+typedef enum { PRESSURE_LOG, PRESSURE_TERM, PRESSURE_KILL } pressure_action_t;
+
+#define MAX_PRESSURE_TRIGGERS 8
+
+typedef struct {
+  int ntriggers;
+  /* PSI trigger fds, they signal POLLPRI (exceptfds for select()) */
+  int fds[MAX_PRESSURE_TRIGGERS];
+  char *specs[MAX_PRESSURE_TRIGGERS];
+  pressure_action_t action;
+} pressure_monitor;
+
+bool is_valid_pressure_spec(const char *s);
+bool string_to_pressure_action(pressure_action_t *result, const char *s);
+pressure_monitor *pressure_open(const char *cgroup, strlist *specs, pressure_action_t action);
+void pressure_close(pressure_monitor *m);
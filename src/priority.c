@@ -0,0 +1,107 @@
+#include "priority.h"
+#include <sched.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_LEVELS 8
+#define IOPRIO_VALUE(class, level) (((class) << IOPRIO_CLASS_SHIFT) | (level))
+
+bool string_to_sched_policy(sched_policy_t *result, const char *s) {
+  bool ret = true;
+
+  if(!strcmp(s, "other"))
+    *result = SCHED_POLICY_OTHER;
+  else if(!strcmp(s, "batch"))
+    *result = SCHED_POLICY_BATCH;
+  else if(!strcmp(s, "idle"))
+    *result = SCHED_POLICY_IDLE;
+  else
+    ret = false;
+
+  return ret;
+}
+
+/* CLASS[:LEVEL], CLASS is rt, be or idle and LEVEL is 0 (highest) to 7 */
+bool string_to_ioprio(int *ioprio, const char *s) {
+  unsigned int level = 0;
+  const char *colon;
+  size_t len;
+  int class;
+
+  colon = strchr(s, ':');
+  len = colon != NULL ? (size_t)(colon - s) : strlen(s);
+  if(len == 2 && !strncmp(s, "rt", len))
+    class = IOPRIO_CLASS_RT;
+  else if(len == 2 && !strncmp(s, "be", len))
+    class = IOPRIO_CLASS_BE;
+  else if(len == 4 && !strncmp(s, "idle", len))
+    class = IOPRIO_CLASS_IDLE;
+  else
+    return false;
+  if(colon != NULL && (!string_to_unsigned_integer(&level, colon + 1) || level >= IOPRIO_LEVELS))
+    return false;
+
+  *ioprio = IOPRIO_VALUE(class, class == IOPRIO_CLASS_IDLE ? 0 : level);
+  return true;
+}
+
+/* Orders I/O priorities from highest (0) to lowest */
+int ioprio_rank(int ioprio) {
+  return ((ioprio >> IOPRIO_CLASS_SHIFT) - 1) * IOPRIO_LEVELS + (ioprio & (IOPRIO_LEVELS - 1));
+}
+
+/* The realtime class needs CAP_SYS_ADMIN, which the jail does not have
+ * when its priority is applied */
+bool ioprio_is_realtime(int ioprio) {
+  return (ioprio >> IOPRIO_CLASS_SHIFT) == IOPRIO_CLASS_RT;
+}
+
+/* Like the CPU placement, these are inherited by children and kept
+ * across execve() */
+void apply_priority(const priority_options *p) {
+  struct sched_param param;
+  int policy = -1;
+
+  switch(p->policy) {
+    case SCHED_POLICY_OTHER:
+      policy = SCHED_OTHER;
+      break;
+    case SCHED_POLICY_BATCH:
+      policy = SCHED_BATCH;
+      break;
+    case SCHED_POLICY_IDLE:
+      policy = SCHED_IDLE;
+      break;
+    default:
+      break;
+  }
+  if(policy != -1) {
+    memset(&param, 0, sizeof(param));
+    if( sched_setscheduler(0, policy, &param) == -1 )
+      errExit("sched_setscheduler");
+  }
+
+  if( p->has_nice && setpriority(PRIO_PROCESS, 0, p->nice) == -1 )
+    errExit("setpriority");
+  else if( !p->has_nice && p->has_min_nice && getpriority(PRIO_PROCESS, 0) < p->min_nice
+           && setpriority(PRIO_PROCESS, 0, p->min_nice) == -1 )
+    errExit("setpriority");
+
+  if( p->has_ioprio && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, p->ioprio) == -1 )
+    errExit("ioprio_set");
+  else if( !p->has_ioprio && p->has_min_ioprio
+           && ioprio_rank(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0)) < ioprio_rank(p->min_ioprio)
+           && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, p->min_ioprio) == -1 )
+    errExit("ioprio_set");
+
+  if( p->has_timer_slack && prctl(PR_SET_TIMERSLACK, p->timer_slack, 0, 0, 0) == -1 )
+    errExit("prctl(PR_SET_TIMERSLACK)");
+}
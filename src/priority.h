@@ -0,0 +1,27 @@
+#pragma once
+
+#include "common.h"
+
+typedef enum { SCHED_POLICY_DEFAULT, SCHED_POLICY_OTHER, SCHED_POLICY_BATCH, SCHED_POLICY_IDLE } sched_policy_t;
+
+typedef struct {
+  sched_policy_t policy;
+  bool has_nice;
+  int nice;
+  bool has_ioprio;
+  int ioprio;
+  /* the administrator's floor, applied when no value was given */
+  bool has_min_nice;
+  int min_nice;
+  bool has_min_ioprio;
+  int min_ioprio;
+  bool has_timer_slack;
+  unsigned long timer_slack;
+} priority_options;
+
+bool string_to_sched_policy(sched_policy_t *result, const char *s);
+bool string_to_ioprio(int *ioprio, const char *s);
+int ioprio_rank(int ioprio);
+bool ioprio_is_realtime(int ioprio);
+
+void apply_priority(const priority_options *p);
@@ -4,14 +4,22 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-void redirect_to_dev_null(bool keep_output) {
+void redirect_to_dev_null(bool keep_output, int logfd) {
   int fd;
 
   if((fd = open("/dev/null", O_RDWR)) == -1)
     errExit("open(/dev/null)");
   close(0);
   dup2(fd, 0);
-  if(!keep_output) {
+  if(logfd != -1) {
+    /* send stdout and stderr to the supervisor's log pipe */
+    close(1);
+    close(2);
+    dup2(logfd, 1);
+    dup2(logfd, 2);
+    close(logfd);
+  }
+  else if(!keep_output) {
     close(1);
     close(2);
     dup2(fd, 1);
@@ -2,4 +2,4 @@
 
 #include "common.h"
 
-void redirect_to_dev_null(bool keep_output);
+void redirect_to_dev_null(bool keep_output, int logfd);
@@ -0,0 +1,115 @@
+#include "scratch.h"
+#include "priority.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Every jail gets its own directory below the --scratch-dir. When the
+ * jail is gone, the directory is renamed out of the way and deleted by
+ * a background process at idle priority, so the jail's exit does not
+ * wait for millions of files to be unlinked.
+ */
+#define SCRATCH_TEMPLATE "appjail-XXXXXX"
+#define DELETED_TEMPLATE ".appjail-deleted-XXXXXX"
+
+char *scratch_create(const char *base) {
+  char path[PATH_MAX];
+  int fd;
+
+  if( snprintf(path, PATH_MAX, "%s/" SCRATCH_TEMPLATE, base) >= PATH_MAX )
+    errExitNoErrno("The --scratch-dir path is too long.");
+  if( mkdtemp(path) == NULL )
+    errExit("Unable to create a directory in the --scratch-dir");
+  if( (fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 )
+    errExit("open scratch directory");
+  /* The jail sets the final permissions */
+  if( mkdirat(fd, SCRATCH_TMP, 0700) == -1
+      || mkdirat(fd, SCRATCH_VARTMP, 0700) == -1
+      || mkdirat(fd, SCRATCH_HOME, 0755) == -1 )
+    errExit("mkdir scratch directory");
+  close(fd);
+
+  return strdup(path);
+}
+
+static void remove_tree(int dirfd) {
+  struct dirent *e;
+  struct stat st;
+  bool removed;
+  DIR *d;
+  int fd;
+
+  if( (d = fdopendir(dirfd)) == NULL ) {
+    close(dirfd);
+    return;
+  }
+  /* Entries may be skipped while the directory changes under
+   * readdir(), read it again until nothing more can be removed */
+  do {
+    removed = false;
+    while( (e = readdir(d)) != NULL ) {
+      if(!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+        continue;
+      if( e->d_type == DT_UNKNOWN && fstatat(dirfd, e->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 )
+        e->d_type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+      if( e->d_type == DT_DIR
+          && (fd = openat(dirfd, e->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) != -1 ) {
+        /* the jail may have left directories we cannot write to */
+        fchmod(fd, S_IRWXU);
+        remove_tree(fd);
+      }
+      if( unlinkat(dirfd, e->d_name, e->d_type == DT_DIR ? AT_REMOVEDIR : 0) == 0 )
+        removed = true;
+    }
+    rewinddir(d);
+  } while(removed);
+  closedir(d);
+}
+
+/* Delete the jail's scratch directory without waiting for it. What
+ * cannot be deleted is left behind in the renamed directory.
+ */
+void scratch_remove(const char *path) {
+  char deleted[PATH_MAX], *slash;
+  priority_options idle;
+  pid_t pid;
+  int fd;
+
+  snprintf(deleted, PATH_MAX, "%s", path);
+  if( (slash = strrchr(deleted, '/')) == NULL )
+    return;
+  snprintf(slash + 1, PATH_MAX - (slash + 1 - deleted), DELETED_TEMPLATE);
+  /* rename() replaces the new empty directory atomically */
+  if( mkdtemp(deleted) == NULL || rename(path, deleted) == -1 ) {
+    errWarn("Unable to remove the scratch directory");
+    return;
+  }
+
+  /* Double fork, the cleaner is not our child and nobody waits for it */
+  fflush(NULL);
+  if( (pid = fork()) == -1 ) {
+    errWarn("fork");
+    return;
+  }
+  if( pid > 0 ) {
+    waitpid(pid, NULL, 0);
+    return;
+  }
+  if( setsid() == -1 || fork() != 0 )
+    _exit(EXIT_SUCCESS);
+
+  memset(&idle, 0, sizeof(idle));
+  idle.policy = SCHED_POLICY_IDLE;
+  idle.has_ioprio = string_to_ioprio(&(idle.ioprio), "idle");
+  apply_priority(&idle);
+  if( (fd = open(deleted, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) != -1 )
+    remove_tree(fd);
+  rmdir(deleted);
+  _exit(EXIT_SUCCESS);
+}
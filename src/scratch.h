@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.h"
+
+/* The jail's private directories in a scratch directory */
+#define SCRATCH_TMP "tmp"
+#define SCRATCH_VARTMP "vartmp"
+#define SCRATCH_HOME "home"
+
+char *scratch_create(const char *base);
+void scratch_remove(const char *path);
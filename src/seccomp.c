@@ -0,0 +1,357 @@
+#include "seccomp.h"
+#include "cap.h"
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#if defined(__x86_64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__i386__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_I386
+#elif defined(__aarch64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#elif defined(__arm__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_ARM
+#elif defined(__powerpc64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_PPC64LE
+#elif defined(__powerpc64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_PPC64
+#elif defined(__s390x__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_S390X
+#elif defined(__riscv) && __riscv_xlen == 64
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_RISCV64
+#endif
+
+#ifndef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_RET_KILL_PROCESS SECCOMP_RET_KILL
+#endif
+
+/* x32 system calls share the x86_64 audit architecture */
+#define X32_SYSCALL_BIT 0x40000000
+
+/* The filter is a binary search over the sorted system call numbers,
+ * ending in short linear runs of at most LEAF_SIZE comparisons. Any
+ * system call is decided after about log2(n) + LEAF_SIZE instructions,
+ * instead of one comparison per denied system call.
+ */
+#define LEAF_SIZE 4
+#define MAX_FILTER_LEN 1024
+
+/* System calls that only serve to administer the host */
+static const int default_denied[] = {
+#ifdef __NR__sysctl
+  __NR__sysctl,
+#endif
+#ifdef __NR_acct
+  __NR_acct,
+#endif
+#ifdef __NR_add_key
+  __NR_add_key,
+#endif
+#ifdef __NR_adjtimex
+  __NR_adjtimex,
+#endif
+#ifdef __NR_bpf
+  __NR_bpf,
+#endif
+#ifdef __NR_clock_adjtime
+  __NR_clock_adjtime,
+#endif
+#ifdef __NR_clock_settime
+  __NR_clock_settime,
+#endif
+#ifdef __NR_create_module
+  __NR_create_module,
+#endif
+#ifdef __NR_delete_module
+  __NR_delete_module,
+#endif
+#ifdef __NR_finit_module
+  __NR_finit_module,
+#endif
+#ifdef __NR_fsconfig
+  __NR_fsconfig,
+#endif
+#ifdef __NR_fsmount
+  __NR_fsmount,
+#endif
+#ifdef __NR_fsopen
+  __NR_fsopen,
+#endif
+#ifdef __NR_fspick
+  __NR_fspick,
+#endif
+#ifdef __NR_get_kernel_syms
+  __NR_get_kernel_syms,
+#endif
+#ifdef __NR_init_module
+  __NR_init_module,
+#endif
+#ifdef __NR_ioperm
+  __NR_ioperm,
+#endif
+#ifdef __NR_iopl
+  __NR_iopl,
+#endif
+#ifdef __NR_kexec_file_load
+  __NR_kexec_file_load,
+#endif
+#ifdef __NR_kexec_load
+  __NR_kexec_load,
+#endif
+#ifdef __NR_keyctl
+  __NR_keyctl,
+#endif
+#ifdef __NR_lookup_dcookie
+  __NR_lookup_dcookie,
+#endif
+#ifdef __NR_mount
+  __NR_mount,
+#endif
+#ifdef __NR_mount_setattr
+  __NR_mount_setattr,
+#endif
+#ifdef __NR_move_mount
+  __NR_move_mount,
+#endif
+#ifdef __NR_nfsservctl
+  __NR_nfsservctl,
+#endif
+#ifdef __NR_open_by_handle_at
+  __NR_open_by_handle_at,
+#endif
+#ifdef __NR_open_tree
+  __NR_open_tree,
+#endif
+#ifdef __NR_perf_event_open
+  __NR_perf_event_open,
+#endif
+#ifdef __NR_pivot_root
+  __NR_pivot_root,
+#endif
+#ifdef __NR_query_module
+  __NR_query_module,
+#endif
+#ifdef __NR_quotactl
+  __NR_quotactl,
+#endif
+#ifdef __NR_reboot
+  __NR_reboot,
+#endif
+#ifdef __NR_request_key
+  __NR_request_key,
+#endif
+#ifdef __NR_settimeofday
+  __NR_settimeofday,
+#endif
+#ifdef __NR_stime
+  __NR_stime,
+#endif
+#ifdef __NR_swapoff
+  __NR_swapoff,
+#endif
+#ifdef __NR_swapon
+  __NR_swapon,
+#endif
+#ifdef __NR_sysfs
+  __NR_sysfs,
+#endif
+#ifdef __NR_umount
+  __NR_umount,
+#endif
+#ifdef __NR_umount2
+  __NR_umount2,
+#endif
+#ifdef __NR_uselib
+  __NR_uselib,
+#endif
+#ifdef __NR_userfaultfd
+  __NR_userfaultfd,
+#endif
+#ifdef __NR_ustat
+  __NR_ustat,
+#endif
+#ifdef __NR_vhangup
+  __NR_vhangup,
+#endif
+#ifdef __NR_vm86
+  __NR_vm86,
+#endif
+#ifdef __NR_vm86old
+  __NR_vm86old,
+#endif
+};
+
+/* In addition to the default profile, system calls that inspect other
+ * processes or leave the jail's namespaces */
+static const int strict_denied[] = {
+#ifdef __NR_io_uring_enter
+  __NR_io_uring_enter,
+#endif
+#ifdef __NR_io_uring_register
+  __NR_io_uring_register,
+#endif
+#ifdef __NR_io_uring_setup
+  __NR_io_uring_setup,
+#endif
+#ifdef __NR_kcmp
+  __NR_kcmp,
+#endif
+#ifdef __NR_name_to_handle_at
+  __NR_name_to_handle_at,
+#endif
+#ifdef __NR_personality
+  __NR_personality,
+#endif
+#ifdef __NR_process_vm_readv
+  __NR_process_vm_readv,
+#endif
+#ifdef __NR_process_vm_writev
+  __NR_process_vm_writev,
+#endif
+#ifdef __NR_ptrace
+  __NR_ptrace,
+#endif
+#ifdef __NR_setns
+  __NR_setns,
+#endif
+#ifdef __NR_syslog
+  __NR_syslog,
+#endif
+#ifdef __NR_unshare
+  __NR_unshare,
+#endif
+};
+
+#define NUM_ELEMENTS(a) (sizeof(a)/sizeof((a)[0]))
+
+#ifdef SECCOMP_AUDIT_ARCH
+typedef struct {
+  struct sock_filter insns[MAX_FILTER_LEN];
+  size_t len;
+} filter;
+
+static void emit(filter *f, unsigned short code, unsigned char jt, unsigned char jf, unsigned int k) {
+  if(f->len == MAX_FILTER_LEN)
+    errExitNoErrno("Internal error: seccomp filter too large.");
+  f->insns[f->len].code = code;
+  f->insns[f->len].jt = jt;
+  f->insns[f->len].jf = jf;
+  f->insns[f->len].k = k;
+  f->len++;
+}
+
+static void emit_tree(filter *f, const int *nrs, size_t n) {
+  size_t i, mid, jump;
+
+  if(n <= LEAF_SIZE) {
+    for(i = 0; i < n; ++i) {
+      emit(f, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, nrs[i]);
+      emit(f, BPF_RET | BPF_K, 0, 0, SECCOMP_RET_ERRNO | (EPERM & SECCOMP_RET_DATA));
+    }
+    emit(f, BPF_RET | BPF_K, 0, 0, SECCOMP_RET_ALLOW);
+    return;
+  }
+
+  /* Numbers below nrs[mid] fall through into the left subtree */
+  mid = n / 2;
+  jump = f->len;
+  emit(f, BPF_JMP | BPF_JGE | BPF_K, 0, 0, nrs[mid]);
+  emit_tree(f, nrs, mid);
+  if(f->len - jump - 1 > 255)
+    errExitNoErrno("Internal error: seccomp filter jump out of range.");
+  f->insns[jump].jt = f->len - jump - 1;
+  emit_tree(f, nrs + mid, n - mid);
+}
+
+static int compare_int(const void *a, const void *b) {
+  return *(const int*)a - *(const int*)b;
+}
+
+static size_t collect_denied(int *nrs, seccomp_profile_t profile) {
+  size_t n = 0, i, j;
+
+  memcpy(nrs, default_denied, sizeof(default_denied));
+  n = NUM_ELEMENTS(default_denied);
+  if(profile == SECCOMP_STRICT) {
+    memcpy(nrs + n, strict_denied, sizeof(strict_denied));
+    n += NUM_ELEMENTS(strict_denied);
+  }
+
+  qsort(nrs, n, sizeof(int), compare_int);
+  for(i = 0, j = 0; i < n; ++i)
+    if(j == 0 || nrs[j-1] != nrs[i])
+      nrs[j++] = nrs[i];
+  return j;
+}
+
+static void compile_filter(filter *f, seccomp_profile_t profile) {
+  int nrs[NUM_ELEMENTS(default_denied) + NUM_ELEMENTS(strict_denied)];
+  size_t n;
+
+  n = collect_denied(nrs, profile);
+  f->len = 0;
+
+  /* Kill processes that use a different system call ABI */
+  emit(f, BPF_LD | BPF_W | BPF_ABS, 0, 0, offsetof(struct seccomp_data, arch));
+  emit(f, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, SECCOMP_AUDIT_ARCH);
+  emit(f, BPF_RET | BPF_K, 0, 0, SECCOMP_RET_KILL_PROCESS);
+  emit(f, BPF_LD | BPF_W | BPF_ABS, 0, 0, offsetof(struct seccomp_data, nr));
+#if defined(__x86_64__)
+  /* x32 shares our audit architecture, but not our system call numbers */
+  emit(f, BPF_JMP | BPF_JGE | BPF_K, 0, 1, X32_SYSCALL_BIT);
+  emit(f, BPF_RET | BPF_K, 0, 0, SECCOMP_RET_KILL_PROCESS);
+#endif
+  emit_tree(f, nrs, n);
+}
+#endif
+
+bool string_to_seccomp_profile(seccomp_profile_t *result, const char *s) {
+  bool ret = true;
+
+  if(!strcmp(s, "none"))
+    *result = SECCOMP_NONE;
+  else if(!strcmp(s, "default"))
+    *result = SECCOMP_DEFAULT;
+  else if(!strcmp(s, "strict"))
+    *result = SECCOMP_STRICT;
+  else
+    ret = false;
+
+  return ret;
+}
+
+void apply_seccomp_profile(seccomp_profile_t profile) {
+#ifdef SECCOMP_AUDIT_ARCH
+  static filter f;
+  struct sock_fprog prog;
+
+  if(profile == SECCOMP_NONE)
+    return;
+
+  compile_filter(&f, profile);
+  prog.len = f.len;
+  prog.filter = f.insns;
+
+  /* Without no_new_privs (--allow-new-privs), installing a filter
+   * requires CAP_SYS_ADMIN */
+  if( prctl(PR_GET_NO_NEW_PRIVS, 0, 0, 0, 0) == 1 ) {
+    if( prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0) == -1 )
+      errExit("prctl(PR_SET_SECCOMP)");
+  }
+  else {
+    need_cap(CAP_SYS_ADMIN);
+    if( prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0) == -1 )
+      errExit("prctl(PR_SET_SECCOMP)");
+    drop_caps();
+  }
+#else
+  if(profile != SECCOMP_NONE)
+    errExitNoErrno("Seccomp filters are not supported on this architecture.");
+#endif
+}
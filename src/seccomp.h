@@ -0,0 +1,8 @@
+#pragma once
+
+#include "common.h"
+
+typedef enum { SECCOMP_NONE, SECCOMP_DEFAULT, SECCOMP_STRICT } seccomp_profile_t;
+
+bool string_to_seccomp_profile(seccomp_profile_t *result, const char *s);
+void apply_seccomp_profile(seccomp_profile_t profile);
@@ -0,0 +1,607 @@
+#include "server.h"
+#include "appjail.h"
+#include "cap.h"
+#include "cgroup.h"
+#include "configfile.h"
+#include "identity.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* The launch server keeps the configuration and capabilities of one
+ * appjail process around and launches jails on request. Requests come
+ * in over a SOCK_SEQPACKET unix socket that only accepts connections
+ * from our own user. Each connection carries exactly one request, a
+ * list of NUL-separated words, and receives one text reply:
+ *
+ *   launch ARGS...   start "appjail ARGS..." with the three file
+ *                    descriptors passed via SCM_RIGHTS as stdin,
+ *                    stdout and stderr; replies "ok ID PID"
+ *   list             one line "ID PID STATE COMMAND" per jail
+ *   status ID        "running", "frozen", "initializing" or "exited STATUS"
+ *   kill ID [SIG]    forward SIGTERM (or SIGHUP, SIGINT) to the jail,
+ *                    thawing it first if it is frozen
+ *   freeze ID        stop all processes of a jail that runs in its own
+ *   thaw ID          cgroup (--cgroup), or resume them
+ *   stats            aggregated launch metrics
+ *
+ * Every jail is supervised by its own forked process, just like a jail
+ * started by appjail directly. The server's event loop only keeps track
+ * of those processes.
+ */
+
+#define MAX_REQUEST_SIZE 65536
+#define MAX_REQUEST_WORDS 1024
+#define MAX_EXITED_JAILS 1024
+#define MAX_COMMAND_LEN 256
+/* Accepted connections wait in the event loop for their request. A
+ * client that sends nothing is dropped after PENDING_TIMEOUT seconds,
+ * or when MAX_PENDING newer connections arrived. */
+#define MAX_PENDING 64
+#define PENDING_TIMEOUT 1
+
+typedef enum { JAIL_INITIALIZING, JAIL_RUNNING, JAIL_EXITED } jail_state_t;
+
+typedef struct {
+  unsigned int id;
+  pid_t pid;
+  char *command;
+  jail_state_t state;
+  int status;
+  struct timespec requested;
+} jail;
+
+static jail *jails = NULL;
+static size_t num_jails = 0, max_jails = 0, num_exited = 0;
+static unsigned int next_id = 1;
+
+static struct {
+  int fd;
+  struct timespec accepted;
+} pending[MAX_PENDING];
+static size_t num_pending = 0;
+
+static struct {
+  unsigned long long int launched, failed, initialized;
+  unsigned long long int total_latency_us, max_latency_us;
+} stats;
+
+static jail *find_jail_by_pid(pid_t pid) {
+  size_t i;
+
+  /* PIDs of exited jails may have been reused */
+  for(i = 0; i < num_jails; ++i)
+    if(jails[i].pid == pid && jails[i].state != JAIL_EXITED)
+      return &jails[i];
+  return NULL;
+}
+
+static jail *find_jail_by_id(const char *s) {
+  unsigned int id;
+  size_t i;
+
+  if(!string_to_unsigned_integer(&id, s))
+    return NULL;
+  for(i = 0; i < num_jails; ++i)
+    if(jails[i].id == id)
+      return &jails[i];
+  return NULL;
+}
+
+static void forget_oldest_exited_jail() {
+  size_t i;
+
+  for(i = 0; i < num_jails; ++i)
+    if(jails[i].state == JAIL_EXITED) {
+      free(jails[i].command);
+      memmove(&jails[i], &jails[i+1], (num_jails - i - 1) * sizeof(jail));
+      num_jails--;
+      num_exited--;
+      return;
+    }
+}
+
+static jail *add_jail(char **words, int nwords) {
+  char command[MAX_COMMAND_LEN];
+  size_t len = 0;
+  jail *j;
+  int i;
+
+  /* Remember the command line for "list" */
+  command[0] = '\0';
+  for(i = 1; i < nwords && len < sizeof(command) - 1; ++i)
+    len += snprintf(command + len, sizeof(command) - len, i > 1 ? " %s" : "%s", words[i]);
+
+  if(num_exited >= MAX_EXITED_JAILS)
+    forget_oldest_exited_jail();
+  if(num_jails == max_jails) {
+    max_jails = max_jails == 0 ? 16 : 2 * max_jails;
+    if( (jails = realloc(jails, max_jails * sizeof(jail))) == NULL )
+      errExit("realloc");
+  }
+  j = &jails[num_jails++];
+  j->id = next_id++;
+  j->pid = -1;
+  j->command = strdup(command);
+  j->state = JAIL_INITIALIZING;
+  j->status = 0;
+  clock_gettime(CLOCK_MONOTONIC, &(j->requested));
+  return j;
+}
+
+static void reply(int conn, const char *msg) {
+  if( send(conn, msg, strlen(msg), MSG_NOSIGNAL) == -1 )
+    errWarn("send");
+}
+
+static void handle_launch(int conn, char **words, int nwords, int *fds, int nfds,
+                          const appjail_config *config, int listenfd, int sfd,
+                          int statusfds[2], const sigset_t *oldmask) {
+  identity self;
+  char msg[64];
+  jail *j;
+  pid_t pid;
+  int i;
+
+  if(nfds != 3) {
+    reply(conn, "error launch needs stdin, stdout and stderr\n");
+    return;
+  }
+
+  /* Every launch looks up our own user. The supervisor only inherits a
+   * copy of the identity cache, so refresh it here where it lasts. */
+  if(lookup_identity(getuid(), &self))
+    free_identity(&self);
+
+  j = add_jail(words, nwords);
+  stats.launched++;
+  pid = fork();
+  switch(pid) {
+    case -1:
+      stats.failed++;
+      j->state = JAIL_EXITED;
+      j->status = EXIT_FAILURE;
+      num_exited++;
+      reply(conn, "error fork failed\n");
+      return;
+    case 0:
+      /* Forget about the server, we are the jail's supervisor now */
+      close(listenfd);
+      close(sfd);
+      for(i = 0; i < (int)num_pending; ++i)
+        close(pending[i].fd);
+      close(statusfds[0]);
+      if( sigprocmask(SIG_SETMASK, oldmask, NULL) == -1 )
+        errExit("sigprocmask");
+      if( setsid() == -1 )
+        errExit("setsid");
+      for(i = 0; i < 3; ++i) {
+        if( dup2(fds[i], i) == -1 )
+          errExit("dup2");
+        close(fds[i]);
+      }
+      close(conn);
+      /* "launch" becomes argv[0] */
+      words[0] = APPLICATION_NAME;
+      exit(appjail_launch(nwords, words, config, statusfds[1]));
+    default:
+      j->pid = pid;
+      snprintf(msg, sizeof(msg), "ok %u %d\n", j->id, pid);
+      reply(conn, msg);
+  }
+}
+
+/* The freeze state lives in the jail's cgroup, not here */
+static bool jail_frozen(const jail *j) {
+  char *path;
+  bool ret;
+
+  /* The supervisor created the jail's cgroup next to ours */
+  if( (path = jail_cgroup_of_owner(j->pid)) == NULL )
+    return false;
+  ret = jail_cgroup_frozen(path);
+  free(path);
+  return ret;
+}
+
+static const char *state_name(const jail *j) {
+  switch(j->state) {
+    case JAIL_INITIALIZING:
+      return "initializing";
+    case JAIL_RUNNING:
+      return jail_frozen(j) ? "frozen" : "running";
+    default:
+      return "exited";
+  }
+}
+
+static void handle_list(int conn) {
+  char *buf, line[MAX_COMMAND_LEN + 64];
+  size_t len = 0, size = 4096, n, i;
+
+  if( (buf = malloc(size)) == NULL )
+    errExit("malloc");
+  buf[0] = '\0';
+  for(i = 0; i < num_jails; ++i) {
+    n = snprintf(line, sizeof(line), "%u %d %s %s\n", jails[i].id, jails[i].pid,
+                 state_name(&jails[i]), jails[i].command);
+    if(n >= sizeof(line))
+      n = sizeof(line) - 1;
+    if(len + n + 1 > size) {
+      size = 2 * (len + n + 1);
+      if( (buf = realloc(buf, size)) == NULL )
+        errExit("realloc");
+    }
+    memcpy(buf + len, line, n + 1);
+    len += n;
+  }
+  if(len == 0)
+    reply(conn, "\n");
+  else
+    reply(conn, buf);
+  free(buf);
+}
+
+static void handle_status(int conn, char **words, int nwords) {
+  char msg[64];
+  jail *j;
+
+  if(nwords < 2 || (j = find_jail_by_id(words[1])) == NULL) {
+    reply(conn, "error unknown jail\n");
+    return;
+  }
+  if(j->state == JAIL_EXITED)
+    snprintf(msg, sizeof(msg), "exited %d\n", j->status);
+  else
+    snprintf(msg, sizeof(msg), "%s\n", state_name(j));
+  reply(conn, msg);
+}
+
+static void handle_kill(int conn, char **words, int nwords) {
+  int sig = SIGTERM;
+  char *path;
+  jail *j;
+
+  if(nwords < 2 || (j = find_jail_by_id(words[1])) == NULL) {
+    reply(conn, "error unknown jail\n");
+    return;
+  }
+  if(nwords > 2) {
+    /* Only signals that the supervisor forwards into the jail */
+    if(!strcmp(words[2], "HUP"))
+      sig = SIGHUP;
+    else if(!strcmp(words[2], "INT"))
+      sig = SIGINT;
+    else if(strcmp(words[2], "TERM")) {
+      reply(conn, "error unsupported signal\n");
+      return;
+    }
+  }
+  if(j->state == JAIL_EXITED) {
+    reply(conn, "error jail exited\n");
+    return;
+  }
+  /* A frozen jail would not see the forwarded signal until it is thawed */
+  if( j->state == JAIL_RUNNING && (path = jail_cgroup_of_owner(j->pid)) != NULL ) {
+    if(jail_cgroup_frozen(path) && !jail_cgroup_freeze(path, false)) {
+      reply(conn, "error thaw failed\n");
+      free(path);
+      return;
+    }
+    free(path);
+  }
+  if(kill(j->pid, sig) == -1)
+    reply(conn, "error kill failed\n");
+  else
+    reply(conn, "ok\n");
+}
+
+static void handle_freeze(int conn, char **words, int nwords, bool frozen) {
+  char *path;
+  jail *j;
+
+  if(nwords < 2 || (j = find_jail_by_id(words[1])) == NULL) {
+    reply(conn, "error unknown jail\n");
+    return;
+  }
+  if(j->state != JAIL_RUNNING) {
+    reply(conn, "error jail is not running\n");
+    return;
+  }
+  if( (path = jail_cgroup_of_owner(j->pid)) == NULL ) {
+    reply(conn, "error jail has no cgroup\n");
+    return;
+  }
+  if(!jail_cgroup_freeze(path, frozen))
+    reply(conn, frozen ? "error freeze failed\n" : "error thaw failed\n");
+  else
+    reply(conn, "ok\n");
+  free(path);
+}
+
+static void handle_stats(int conn) {
+  char msg[512];
+  size_t i, running = 0, initializing = 0;
+
+  for(i = 0; i < num_jails; ++i) {
+    if(jails[i].state == JAIL_RUNNING)
+      running++;
+    else if(jails[i].state == JAIL_INITIALIZING)
+      initializing++;
+  }
+  snprintf(msg, sizeof(msg),
+           "launched %llu\n"
+           "failed %llu\n"
+           "initializing %zu\n"
+           "running %zu\n"
+           "launch_latency_avg_us %llu\n"
+           "launch_latency_max_us %llu\n",
+           stats.launched, stats.failed, initializing, running,
+           stats.initialized > 0 ? stats.total_latency_us / stats.initialized : 0,
+           stats.max_latency_us);
+  reply(conn, msg);
+}
+
+static bool peer_is_us(int conn) {
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+
+  if( getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1 )
+    return false;
+  return cred.uid == getuid();
+}
+
+static void remove_pending(size_t i) {
+  close(pending[i].fd);
+  memmove(&pending[i], &pending[i+1], (num_pending - i - 1) * sizeof(pending[0]));
+  num_pending--;
+}
+
+static void accept_connection(int listenfd) {
+  int conn;
+
+  if( (conn = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC)) == -1 ) {
+    errWarn("accept");
+    return;
+  }
+  if(!peer_is_us(conn)) {
+    close(conn);
+    return;
+  }
+  /* Make room by dropping the oldest connection */
+  if(num_pending == MAX_PENDING)
+    remove_pending(0);
+  pending[num_pending].fd = conn;
+  clock_gettime(CLOCK_MONOTONIC, &pending[num_pending].accepted);
+  num_pending++;
+}
+
+/* Drop connections whose request did not arrive in time */
+static void expire_pending() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  while(num_pending > 0 && now.tv_sec - pending[0].accepted.tv_sec > PENDING_TIMEOUT)
+    remove_pending(0);
+}
+
+/* Called when CONN is readable, the request never blocks us */
+static void handle_connection(int conn, int listenfd, int sfd, int statusfds[2],
+                              const appjail_config *config, const sigset_t *oldmask) {
+  char buf[MAX_REQUEST_SIZE + 1];
+  char *words[MAX_REQUEST_WORDS + 1];
+  union {
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  int fds[3], nfds = 0, nwords = 0, i;
+  ssize_t len;
+  char *pos;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = buf;
+  iov.iov_len = MAX_REQUEST_SIZE;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  if( (len = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT)) <= 0 ) {
+    close(conn);
+    return;
+  }
+
+  for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      if(nfds > 3)
+        nfds = 3;
+      memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+    }
+
+  if(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+    reply(conn, "error request too large\n");
+    goto out;
+  }
+
+  /* Split the request into words */
+  buf[len] = '\0';
+  for(pos = buf; pos < buf + len && nwords < MAX_REQUEST_WORDS; pos += strlen(pos) + 1)
+    words[nwords++] = pos;
+  words[nwords] = NULL;
+
+  if(nwords == 0)
+    reply(conn, "error empty request\n");
+  else if(!strcmp(words[0], "launch"))
+    handle_launch(conn, words, nwords, fds, nfds, config, listenfd, sfd, statusfds, oldmask);
+  else if(!strcmp(words[0], "list"))
+    handle_list(conn);
+  else if(!strcmp(words[0], "status"))
+    handle_status(conn, words, nwords);
+  else if(!strcmp(words[0], "kill"))
+    handle_kill(conn, words, nwords);
+  else if(!strcmp(words[0], "freeze"))
+    handle_freeze(conn, words, nwords, true);
+  else if(!strcmp(words[0], "thaw"))
+    handle_freeze(conn, words, nwords, false);
+  else if(!strcmp(words[0], "stats"))
+    handle_stats(conn);
+  else
+    reply(conn, "error unknown request\n");
+
+out:
+  for(i = 0; i < nfds; ++i)
+    close(fds[i]);
+  close(conn);
+}
+
+static void handle_status_pipe(int statusfd) {
+  struct timespec now;
+  unsigned long long int latency;
+  pid_t pid;
+  jail *j;
+
+  if( read(statusfd, &pid, sizeof(pid_t)) != sizeof(pid_t) )
+    return;
+  if( (j = find_jail_by_pid(pid)) == NULL || j->state != JAIL_INITIALIZING )
+    return;
+
+  j->state = JAIL_RUNNING;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  latency = (now.tv_sec - j->requested.tv_sec) * 1000000ULL
+            + (now.tv_nsec - j->requested.tv_nsec) / 1000;
+  stats.initialized++;
+  stats.total_latency_us += latency;
+  if(latency > stats.max_latency_us)
+    stats.max_latency_us = latency;
+}
+
+static void handle_signalfd(int sfd, const char *path) {
+  struct signalfd_siginfo fdsi;
+  pid_t pid;
+  int status;
+  jail *j;
+
+  if( read(sfd, &fdsi, sizeof(struct signalfd_siginfo)) != sizeof(struct signalfd_siginfo) )
+    errExit("read");
+
+  if(fdsi.ssi_signo == SIGCHLD) {
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      if( (j = find_jail_by_pid(pid)) == NULL )
+        continue;
+      if(j->state == JAIL_INITIALIZING)
+        stats.failed++;
+      j->state = JAIL_EXITED;
+      j->status = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+      num_exited++;
+    }
+  }
+  else {
+    /* The jails' supervisors are independent of us, leave them running */
+    unlink(path);
+    exit(EXIT_SUCCESS);
+  }
+}
+
+int server_main(const char *path) {
+  appjail_config *config;
+  struct sockaddr_un addr;
+  sigset_t mask, oldmask;
+  int listenfd, sfd, statusfds[2], nfds, conn;
+  struct timeval timeout;
+  fd_set rfd;
+  mode_t old_umask;
+  size_t i;
+
+  init_caps();
+  config = parse_config();
+  if(config == NULL)
+    exit(EXIT_FAILURE);
+  if(strlen(path) >= sizeof(addr.sun_path))
+    errExitNoErrno("Socket path is too long.");
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if( (listenfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1 )
+    errExit("socket");
+  /* Only our own user may connect. The jails inherit our umask, so
+   * restore it right away. */
+  old_umask = umask(0077);
+  if( bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) == -1 )
+    errExit("bind");
+  umask(old_umask);
+  if( listen(listenfd, SOMAXCONN) == -1 )
+    errExit("listen");
+
+  /* Status pipe, every jail's supervisor reports initialization here */
+  if( pipe2(statusfds, O_CLOEXEC) == -1 )
+    errExit("pipe");
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGHUP);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if( sigprocmask(SIG_BLOCK, &mask, &oldmask) == -1 )
+    errExit("sigprocmask");
+  if( (sfd = signalfd(-1, &mask, SFD_CLOEXEC)) == -1 )
+    errExit("signalfd");
+
+  while(true) {
+    FD_ZERO(&rfd);
+    FD_SET(listenfd, &rfd);
+    FD_SET(sfd, &rfd);
+    FD_SET(statusfds[0], &rfd);
+    nfds = listenfd;
+    if(sfd > nfds)
+      nfds = sfd;
+    if(statusfds[0] > nfds)
+      nfds = statusfds[0];
+    for(i = 0; i < num_pending; ++i) {
+      FD_SET(pending[i].fd, &rfd);
+      if(pending[i].fd > nfds)
+        nfds = pending[i].fd;
+    }
+    /* Wake up to drop connections that never send a request */
+    timeout.tv_sec = PENDING_TIMEOUT;
+    timeout.tv_usec = 0;
+
+    if( select(nfds + 1, &rfd, NULL, NULL, num_pending > 0 ? &timeout : NULL) < 0 ) {
+      if(errno == EINTR)
+        continue;
+      errExit("select");
+    }
+
+    /* Collect initialization reports before exits, so a jail
+     * that exits right away still counts as launched */
+    if( FD_ISSET(statusfds[0], &rfd) )
+      handle_status_pipe(statusfds[0]);
+    if( FD_ISSET(sfd, &rfd) )
+      handle_signalfd(sfd, path);
+    /* Handle the requests that arrived, handle_connection() closes
+     * the connection. Walk backwards, the array shrinks. */
+    for(i = num_pending; i > 0; --i)
+      if( FD_ISSET(pending[i-1].fd, &rfd) ) {
+        conn = pending[i-1].fd;
+        memmove(&pending[i-1], &pending[i], (num_pending - i) * sizeof(pending[0]));
+        num_pending--;
+        handle_connection(conn, listenfd, sfd, statusfds, config, &oldmask);
+      }
+    expire_pending();
+    if( FD_ISSET(listenfd, &rfd) )
+      accept_connection(listenfd);
+  }
+}
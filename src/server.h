@@ -0,0 +1,5 @@
+#pragma once
+
+#include "common.h"
+
+int server_main(const char *path);
@@ -2,12 +2,13 @@
 
 #include "setuid.h"
 
-int switch_ids(uid_t newIdentity) {
-  if (cap_setreuid(newIdentity)) {
+int switch_ids(const identity *newIdentity) {
+  /* Change the groups first, this needs CAP_SETGID */
+  if (cap_setregid(newIdentity->gid, newIdentity->ngroups, newIdentity->groups)) {
     return -1;
   }
 
-  if (cap_setregid(newIdentity)) {
+  if (cap_setreuid(newIdentity->uid)) {
     return -1;
   }
 
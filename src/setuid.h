@@ -3,5 +3,6 @@
 #include <sys/types.h>
 
 #include "cap.h"
+#include "identity.h"
 
-int switch_ids(uid_t newIdentity);
+int switch_ids(const identity *newIdentity);
@@ -0,0 +1,76 @@
+/* appjail-supervise: the supervisor of a jail that needs nothing but
+ * signal forwarding. Once a plain jail is initialized, appjail replaces
+ * itself with this statically linked program, so thousands of waiting
+ * supervisors do not keep GLib, libnl, libmount and libcap mapped.
+ *
+ * Usage: appjail-supervise PID PIDFD
+ *
+ * PID is our child, the jail's init process. PIDFD refers to it, or is
+ * -1. The signals that appjail forwards are still blocked and pending
+ * ones are still queued, they are read with a new signalfd.
+ */
+#include "common.h"
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+static bool reap_child(pid_t pid1, int pidfd, int *code) {
+  siginfo_t info;
+  int status;
+
+  if( pidfd != -1 ) {
+    memset(&info, 0, sizeof(info));
+    if( waitid(P_PIDFD, pidfd, &info, WEXITED | WNOHANG) == 0 ) {
+      if( info.si_pid == 0 )
+        return false;
+      *code = info.si_code == CLD_EXITED ? info.si_status : EXIT_FAILURE;
+      return true;
+    }
+  }
+  if( waitpid(pid1, &status, WNOHANG) <= 0 )
+    return false;
+  *code = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  struct signalfd_siginfo fdsi;
+  sigset_t mask;
+  int pid1, pidfd, sfd, code;
+
+  if( argc != 3 || !string_to_integer(&pid1, argv[1]) || !string_to_integer(&pidfd, argv[2]) ) {
+    fprintf(stderr, "This program is only used by " APPLICATION_NAME ".\n");
+    return EXIT_FAILURE;
+  }
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGHUP);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if( sigprocmask(SIG_BLOCK, &mask, NULL) == -1 )
+    errExit("sigprocmask");
+  if( (sfd = signalfd(-1, &mask, SFD_CLOEXEC)) == -1 )
+    errExit("signalfd");
+
+  /* The jail may have exited before the exec */
+  while( !reap_child(pid1, pidfd, &code) ) {
+    if( read(sfd, &fdsi, sizeof(fdsi)) != sizeof(fdsi) )
+      errExit("read");
+    if( fdsi.ssi_signo == SIGCHLD )
+      continue;
+    if( pidfd == -1 || syscall(SYS_pidfd_send_signal, pidfd, fdsi.ssi_signo, NULL, 0) == -1 )
+      kill(pid1, fdsi.ssi_signo);
+  }
+  return code;
+}
@@ -0,0 +1,82 @@
+#include "tasks.h"
+#include "cap.h"
+#include "clone.h"
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Setup steps that block on external work (netlink, the X server) run
+ * in forked processes while child_main() carries on with the mounts.
+ * Every step that depends on a task waits for it explicitly, and all
+ * tasks are joined before the jailed process is executed.
+ */
+
+#define MAX_SETUP_TASKS 8
+
+struct setup_task {
+  const char *name;
+  pid_t pid;
+  bool done;
+};
+
+static setup_task tasks[MAX_SETUP_TASKS];
+static int num_tasks = 0;
+
+/* clone_flags may request namespaces (like CLONE_NEWNS) that are
+ * created atomically with the task, before child_main() goes on.
+ */
+setup_task *task_start(const char *name, int clone_flags, int (*fn)(void *), void *arg) {
+  setup_task *t;
+
+  if(num_tasks == MAX_SETUP_TASKS)
+    errExitNoErrno("Internal error: too many setup tasks.");
+  t = &tasks[num_tasks++];
+  t->name = name;
+  t->done = false;
+
+  /* Don't duplicate buffered output */
+  fflush(NULL);
+  if(clone_flags != 0)
+    need_cap(CAP_SYS_ADMIN);
+  t->pid = clone1(clone_flags | SIGCHLD);
+  if(clone_flags != 0)
+    drop_caps();
+  switch(t->pid) {
+    case -1:
+      errExit("clone");
+    case 0:
+      exit(fn(arg));
+    default:
+      return t;
+  }
+}
+
+static void reap_task() {
+  pid_t pid;
+  int status, i;
+
+  if( (pid = waitpid(-1, &status, 0)) == -1 )
+    errExit("waitpid");
+  for(i = 0; i < num_tasks; ++i)
+    if(tasks[i].pid == pid) {
+      tasks[i].done = true;
+      if(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "Setup step %s failed.\n", tasks[i].name);
+        exit(EXIT_FAILURE);
+      }
+      return;
+    }
+}
+
+void task_wait(setup_task *t) {
+  while(!t->done)
+    reap_task();
+}
+
+void task_wait_all() {
+  int i;
+
+  for(i = 0; i < num_tasks; ++i)
+    task_wait(&tasks[i]);
+}
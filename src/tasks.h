@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common.h"
+
+typedef struct setup_task setup_task;
+
+setup_task *task_start(const char *name, int clone_flags, int (*fn)(void *), void *arg);
+void task_wait(setup_task *t);
+void task_wait_all();
@@ -1,41 +1,105 @@
 #include "wait.h"
 #include "common.h"
+#include "scratch.h"
 
+#include <fcntl.h>
+#include <string.h>
 #include <sys/select.h>
 #include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 
-static void handle_signalfd(int sfd, pid_t pid1, bool daemonize, bool child_initialized) {
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+/* Reap our child if it has exited. The pidfd is preferred, it cannot
+ * refer to a recycled PID.
+ */
+static bool reap_child(pid_t pid1, int pidfd, int *code, int *sig) {
+  siginfo_t info;
+  int status;
+
+  if( pidfd != -1 ) {
+    memset(&info, 0, sizeof(info));
+    if( waitid(P_PIDFD, pidfd, &info, WEXITED | WNOHANG) == 0 ) {
+      if( info.si_pid == 0 )
+        return false;
+      *code = info.si_code == CLD_EXITED ? info.si_status : EXIT_FAILURE;
+      *sig = info.si_code == CLD_EXITED ? 0 : info.si_status;
+      return true;
+    }
+    /* P_PIDFD is not supported by this kernel, the PID is still
+     * valid until we reap the child */
+  }
+  if( waitpid(pid1, &status, WNOHANG) <= 0 )
+    return false;
+  *code = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+  *sig = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+  return true;
+}
+
+static void forward_signal(pid_t pid1, int pidfd, int sig) {
+  if( pidfd != -1 && syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0) == 0 )
+    return;
+  kill(pid1, sig);
+}
+
+/* Remove the jail's cgroup and scratch directory before the supervisor exits */
+static void cleanup(const child_options *chldopts) {
+  if( chldopts->cgroup != NULL )
+    jail_cgroup_remove(chldopts->cgroup);
+  if( chldopts->scratch != NULL )
+    scratch_remove(chldopts->scratch);
+}
+
+static void handle_signalfd(int sfd, pid_t pid1, const child_options *chldopts, bool daemonize, bool child_initialized, log_output *log) {
   struct signalfd_siginfo fdsi;
-  pid_t spid;
+  int pidfd = chldopts->pidfd;
   size_t s;
-  int status;
+  int code, sig;
 
   s = read(sfd, &fdsi, sizeof(struct signalfd_siginfo));
   if (s != sizeof(struct signalfd_siginfo))
     errExit("read");
 
   if(fdsi.ssi_signo == SIGCHLD) {
-    while((spid = waitpid(-1, &status, WNOHANG)) > 0)
-      if(!daemonize && spid == pid1) {
-        if(child_initialized) {
-          if( WIFEXITED(status) )
-            exit( WEXITSTATUS(status) );
-          else
-            exit( EXIT_FAILURE );
-        }
-        else {
-          fprintf(stderr, APPLICATION_NAME ": Child failed to initialize.\n");
-          exit(EXIT_FAILURE);
-        }
+    if(!reap_child(pid1, pidfd, &code, &sig))
+      return;
+    if(daemonize) {
+      /* A --notify-ready jail that exits after its setup never became ready */
+      if(child_initialized && chldopts->notify != NULL) {
+        fprintf(stderr, APPLICATION_NAME ": Child exited before it was ready.\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    else {
+      event_log_write(chldopts->events, "exit", "\"code\":%d,\"signal\":%d,\"initialized\":%s",
+                      code, sig, child_initialized ? "true" : "false");
+      if(log != NULL)
+        log_output_flush(log);
+      cleanup(chldopts);
+      if(chldopts->notify != NULL && chldopts->notify->timed_out)
+        exit(EXIT_FAILURE);
+      if(child_initialized)
+        exit(code);
+      else {
+        fprintf(stderr, APPLICATION_NAME ": Child failed to initialize.\n");
+        exit(EXIT_FAILURE);
       }
+    }
+  }
+  else {
+    forward_signal(pid1, pidfd, fdsi.ssi_signo);
+    event_log_write(chldopts->events, "signal", "\"signal\":%u", fdsi.ssi_signo);
   }
-  else
-    kill(pid1, fdsi.ssi_signo);
 }
 
 
-static void handle_pipe(int *pipefd, bool daemonize, bool *child_initialized) {
+static void handle_pipe(int *pipefd, const child_options *chldopts, bool daemonize, bool *child_initialized, int readyfd) {
   size_t s;
   uint8_t u = 0;
 
@@ -52,26 +116,124 @@ static void handle_pipe(int *pipefd, bool daemonize, bool *child_initialized) {
     }
     else {
       fprintf(stderr, APPLICATION_NAME ": Child failed to initialize.\n");
+      cleanup(chldopts);
       exit(EXIT_FAILURE);
     }
   }
   else if(s == sizeof(uint8_t) && u == 1) {
     /* child was successfully initialized */
     fprintf(stderr, APPLICATION_NAME ": Child initialized.\n");
+    event_log_write(chldopts->events, "initialized", NULL);
     *child_initialized = true;
+    if( readyfd != -1 ) {
+      pid_t self = getpid();
+      if( write(readyfd, &self, sizeof(pid_t)) != sizeof(pid_t) )
+        errWarn("write");
+      close(readyfd);
+    }
+    /* With --notify-ready, wait for the jail to send READY=1 */
+    if( daemonize && chldopts->notify == NULL )
+      exit(EXIT_SUCCESS);
+  }
+}
+
+static void handle_notify(const child_options *chldopts, bool daemonize) {
+  char status[256], escaped[512];
+
+  if( notify_receive(chldopts->notify, status, sizeof(status)) ) {
+    fprintf(stderr, APPLICATION_NAME ": Child is ready.\n");
+    event_log_write(chldopts->events, "ready", NULL);
     if( daemonize )
       exit(EXIT_SUCCESS);
   }
+  if( status[0] != '\0' ) {
+    json_escape(escaped, sizeof(escaped), status);
+    event_log_write(chldopts->events, "status", "\"status\":\"%s\"", escaped);
+  }
 }
 
-void wait_for_child(pid_t pid1, int sfd, bool daemonize, int pipefd) {
-  int nfds = -1;
-  bool child_initialized = false;
-  fd_set rfd;
+static void handle_notify_timeout(pid_t pid1, const child_options *chldopts, bool daemonize) {
+  if( !notify_timeout(chldopts->notify) )
+    return;
+  fprintf(stderr, APPLICATION_NAME ": Child was not ready after %u seconds, terminating it.\n",
+          chldopts->notify->timeout);
+  event_log_write(chldopts->events, "timeout", "\"seconds\":%u", chldopts->notify->timeout);
+  /* In --daemonize mode, PID1 may be the detached supervisor, which
+   * passes SIGTERM on to the jail */
+  forward_signal(pid1, chldopts->pidfd, SIGTERM);
+  if( daemonize )
+    exit(EXIT_FAILURE);
+}
+
+static void handle_reclaimed(const child_options *chldopts) {
+  unsigned long long int reclaimed;
+  char msg[128];
+
+  if( !idle_reclaimed(chldopts->idle, &reclaimed) )
+    return;
+  snprintf(msg, sizeof(msg), APPLICATION_NAME ": The jail is idle, reclaimed %llu KiB of memory.", reclaimed / 1024);
+  if( chldopts->detached && chldopts->log != NULL )
+    log_output_write(chldopts->log, msg);
+  else
+    fprintf(stderr, "%s\n", msg);
+  event_log_write(chldopts->events, "reclaim", "\"bytes\":%llu", reclaimed);
+}
+
+static void handle_pressure(pid_t pid1, const child_options *chldopts, int i) {
+  const pressure_monitor *m = chldopts->pressure;
+  char msg[128];
+
+  snprintf(msg, sizeof(msg), APPLICATION_NAME ": Pressure threshold %s exceeded%s.", m->specs[i],
+           m->action == PRESSURE_TERM ? ", terminating the jail"
+           : m->action == PRESSURE_KILL ? ", killing the jail" : "");
+  /* A detached supervisor has no terminal, use the log file */
+  if( chldopts->detached && chldopts->log != NULL )
+    log_output_write(chldopts->log, msg);
+  else
+    fprintf(stderr, "%s\n", msg);
+
+  if( m->action == PRESSURE_TERM )
+    forward_signal(pid1, chldopts->pidfd, SIGTERM);
+  else if( m->action == PRESSURE_KILL )
+    forward_signal(pid1, chldopts->pidfd, SIGKILL);
+}
+
+/* A jail without a log, event log, cgroup, scratch directory or
+ * notification socket only needs its signals forwarded. Replace
+ * ourselves with the small static supervisor, which does not keep our
+ * libraries and heap in memory. If it cannot be executed, we go on.
+ */
+static void exec_lean_supervisor(pid_t pid1, const child_options *chldopts) {
+  char pid[16], pidfd[16];
+
+  if( chldopts->log != NULL || chldopts->events != NULL || chldopts->cgroup != NULL
+      || chldopts->scratch != NULL || chldopts->notify != NULL )
+    return;
+  if( chldopts->pidfd != -1 && fcntl(chldopts->pidfd, F_SETFD, 0) == -1 )
+    return;
+  snprintf(pid, sizeof(pid), "%d", (int)pid1);
+  snprintf(pidfd, sizeof(pidfd), "%d", chldopts->pidfd);
+  fflush(NULL);
+  execl(APPJAIL_SUPERVISE, "appjail-supervise", pid, pidfd, NULL);
+  if( chldopts->pidfd != -1 )
+    fcntl(chldopts->pidfd, F_SETFD, FD_CLOEXEC);
+}
+
+void wait_for_child(pid_t pid1, const child_options *chldopts, int pipefd) {
+  int nfds = -1, sfd = chldopts->sfd;
+  bool daemonize = chldopts->daemonize;
+  /* Without a pipe, somebody else waits for the initialization */
+  bool child_initialized = pipefd == -1;
+  /* The launching process of a --daemonize jail leaves the output
+   * to the detached supervisor */
+  log_output *log = daemonize ? NULL : chldopts->log;
+  fd_set rfd, efd;
+  int i;
 
   while(true) {
     nfds = -1;
     FD_ZERO(&rfd);
+    FD_ZERO(&efd);
     FD_SET(sfd, &rfd);
     if(sfd >= nfds)
       nfds = sfd + 1;
@@ -80,14 +242,78 @@ void wait_for_child(pid_t pid1, int sfd, bool daemonize, int pipefd) {
       if(pipefd >= nfds)
         nfds = pipefd + 1;
     }
+    if( log != NULL && log->pipefd[0] != -1 ) {
+      FD_SET(log->pipefd[0], &rfd);
+      if(log->pipefd[0] >= nfds)
+        nfds = log->pipefd[0] + 1;
+    }
+
+    if( chldopts->idle != NULL ) {
+      FD_SET(chldopts->idle->timerfd, &rfd);
+      if(chldopts->idle->timerfd >= nfds)
+        nfds = chldopts->idle->timerfd + 1;
+      if( chldopts->idle->reclaimfd != -1 ) {
+        FD_SET(chldopts->idle->reclaimfd, &rfd);
+        if(chldopts->idle->reclaimfd >= nfds)
+          nfds = chldopts->idle->reclaimfd + 1;
+      }
+    }
+
+    if( chldopts->notify != NULL ) {
+      FD_SET(chldopts->notify->fd, &rfd);
+      if(chldopts->notify->fd >= nfds)
+        nfds = chldopts->notify->fd + 1;
+      if( chldopts->notify->timerfd != -1 ) {
+        FD_SET(chldopts->notify->timerfd, &rfd);
+        if(chldopts->notify->timerfd >= nfds)
+          nfds = chldopts->notify->timerfd + 1;
+      }
+    }
+
+    if( chldopts->pressure != NULL )
+      for(i = 0; i < chldopts->pressure->ntriggers; ++i) {
+        FD_SET(chldopts->pressure->fds[i], &efd);
+        if(chldopts->pressure->fds[i] >= nfds)
+          nfds = chldopts->pressure->fds[i] + 1;
+      }
 
-    if( select(nfds, &rfd, NULL, NULL, NULL) < 0 )
+    if( select(nfds, &rfd, NULL, &efd, NULL) < 0 )
       errExit("select");
 
+    /* A jail may send READY=1 and exit right away */
+    if( chldopts->notify != NULL && FD_ISSET(chldopts->notify->fd, &rfd) )
+      handle_notify(chldopts, daemonize);
+
     if( FD_ISSET(sfd, &rfd) )
-      handle_signalfd(sfd, pid1, daemonize, child_initialized);
+      handle_signalfd(sfd, pid1, chldopts, daemonize, child_initialized, log);
 
-    if( pipefd != -1 && FD_ISSET(pipefd, &rfd) )
-      handle_pipe(&pipefd, daemonize, &child_initialized);
+    if( pipefd != -1 && FD_ISSET(pipefd, &rfd) ) {
+      handle_pipe(&pipefd, chldopts, daemonize, &child_initialized, chldopts->readyfd);
+      if( child_initialized && !daemonize )
+        exec_lean_supervisor(pid1, chldopts);
+    }
+
+    if( chldopts->notify != NULL && chldopts->notify->timerfd != -1
+        && FD_ISSET(chldopts->notify->timerfd, &rfd) )
+      handle_notify_timeout(pid1, chldopts, daemonize);
+
+    if( chldopts->pressure != NULL )
+      for(i = 0; i < chldopts->pressure->ntriggers; ++i)
+        if( FD_ISSET(chldopts->pressure->fds[i], &efd) )
+          handle_pressure(pid1, chldopts, i);
+
+    if( chldopts->idle != NULL && chldopts->idle->reclaimfd != -1
+        && FD_ISSET(chldopts->idle->reclaimfd, &rfd) )
+      handle_reclaimed(chldopts);
+
+    if( chldopts->idle != NULL && FD_ISSET(chldopts->idle->timerfd, &rfd) )
+      idle_check(chldopts->idle);
+
+    if( log != NULL && log->pipefd[0] != -1 && FD_ISSET(log->pipefd[0], &rfd) )
+      if( !log_output_drain(log) ) {
+        /* all writers are gone */
+        close(log->pipefd[0]);
+        log->pipefd[0] = -1;
+      }
   }
 }
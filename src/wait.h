@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "clone.h"
 #include <unistd.h>
 
-void wait_for_child(pid_t pid1, int sfd, bool daemonize, int pipefd);
+void wait_for_child(pid_t pid1, const child_options *chldopts, int pipefd);
@@ -10,22 +10,34 @@
 
 #define TIMEOUT_LEN 20
 
-void get_x11(const appjail_options *opts) {
-  char *cmd_argv[10];
-  char timeout[TIMEOUT_LEN];
-  char *display;
-  int fd;
-
+void get_x11() {
   if( mkdir(APPJAIL_SWAPDIR "/X11-unix", 0755) == -1 )
     errExit("mkdir");
   if( cap_mount("/tmp/.X11-unix", APPJAIL_SWAPDIR "/X11-unix", NULL, MS_BIND, NULL) == -1 )
     errExit("mount --bind");
   if( cap_mount(NULL, APPJAIL_SWAPDIR "/X11-unix", NULL, MS_PRIVATE, NULL) == -1 )
     errExit("mount --make-private");
+}
+
+/* Runs as a setup task while the mounts are rearranged */
+int generate_x11_cookie(void *arg) {
+  const appjail_options *opts = (const appjail_options*)arg;
+  char *cmd_argv[10];
+  char timeout[TIMEOUT_LEN];
+  char *display;
+  int fd;
 
   display = getenv("DISPLAY");
   if( display == NULL )
-    return;
+    return EXIT_SUCCESS;
+
+  /* xauth talks to the X server through /tmp/.X11-unix, which
+   * sanitize_mounts() may unmount at the same time. We run in a
+   * private copy of the mount tree (see child_main()), make sure
+   * nothing propagates into it.
+   */
+  if( cap_mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) == -1 )
+    errExit("mount --make-rprivate /");
 
   if (opts->x11_cookie) {
     cmd_argv[0] = "xauth";
@@ -60,6 +72,7 @@ void get_x11(const appjail_options *opts) {
     close(fd);
   if( run_command(cmd_argv[0], cmd_argv, true) != EXIT_SUCCESS )
     errExit("xauth");
+  return EXIT_SUCCESS;
 }
 
 void setup_x11() {
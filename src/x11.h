@@ -1,5 +1,6 @@
 #pragma once
 #include "opts.h"
 
-void get_x11(const appjail_options *opts);
+void get_x11();
+int generate_x11_cookie(void *arg);
 void setup_x11();